@@ -0,0 +1,475 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input/decompressor.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <string>
+
+namespace input {
+
+CompressedSource::CompressedSource(const std::string &filename)
+    : inbuf(new uint8_t[COMPRESSED_BUF_SIZE]) {
+  if ((fd = open(filename.c_str(), O_RDONLY)) == -1)
+    throw SourceException(std::string("Unable to open file: ") +
+                          strerror(errno));
+
+  struct stat st;
+  if (fstat(fd, &st) == 0) inputSize = st.st_size;
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+CompressedSource::~CompressedSource() { close(fd); }
+
+size_t CompressedSource::readInput() {
+  ssize_t ret;
+
+  do {
+    ret = ::read(fd, inbuf.get(), COMPRESSED_BUF_SIZE);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret == -1)
+    throw SourceException(std::string("Error reading input: ") +
+                          strerror(errno));
+
+  if (ret == 0) inputEof = true;
+  inputOffset += ret;
+
+  return ret;
+}
+
+void CompressedSource::seekInput(uint64_t offset) {
+  if (lseek(fd, offset, SEEK_SET) == -1)
+    throw SourceException(std::string("Error seeking input: ") +
+                          strerror(errno));
+
+  inputOffset = offset;
+  inputEof = false;
+}
+
+XzSource::XzSource(const std::string &filename) : CompressedSource(filename) {
+  loadIndex();
+
+  // LZMA_CONCATENATED behaves like xz -d for multiple streams
+  if (lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+    throw SourceException("XzSource: Unable to initialize decoder");
+}
+
+XzSource::~XzSource() {
+  lzma_end(&strm);
+  lzma_index_end(index, nullptr);
+}
+
+void XzSource::loadIndex() {
+  lzma_stream info = LZMA_STREAM_INIT;
+  lzma_ret ret;
+
+  if (lzma_file_info_decoder(&info, &index, UINT64_MAX, inputSize) != LZMA_OK)
+    throw SourceException("XzSource: Unable to initialize decoder");
+
+  // the decoder only reads the headers, footers and indexes
+  do {
+    if (info.avail_in == 0) {
+      info.next_in = inbuf.get();
+      info.avail_in = readInput();
+      if (info.avail_in == 0) break;
+    }
+
+    ret = lzma_code(&info, LZMA_RUN);
+    if (ret == LZMA_SEEK_NEEDED) {
+      seekInput(info.seek_pos);
+      info.avail_in = 0;
+      ret = LZMA_OK;
+    }
+  } while (ret == LZMA_OK);
+
+  lzma_end(&info);
+  seekInput(0);
+
+  // broken files are reported by the normal decoder
+  if (ret != LZMA_STREAM_END) {
+    lzma_index_end(index, nullptr);
+    index = nullptr;
+    return;
+  }
+
+  uint64_t last = 0;
+  lzma_index_iter_init(&iter, index);
+  while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+    if (iter.block.uncompressed_file_offset >= last + TIME_INDEX_SPAN) {
+      last = iter.block.uncompressed_file_offset;
+      points.push_back(last);
+    }
+  }
+}
+
+void XzSource::initBlock() {
+  lzma_filter filters[LZMA_FILTERS_MAX + 1];
+
+  seekInput(iter.block.compressed_file_offset);
+  size_t n = readInput();
+
+  memset(&block, 0, sizeof(block));
+  block.version = 1;
+  block.check = iter.stream.flags->check;
+  block.filters = filters;
+  block.header_size = lzma_block_header_size_decode(inbuf[0]);
+
+  if (n == 0 || n < block.header_size)
+    throw SourceException("XzSource: Unexpected end of input");
+
+  if (lzma_block_header_decode(&block, nullptr, inbuf.get()) != LZMA_OK)
+    throw SourceException("XzSource: Corrupt input");
+
+  lzma_ret ret = lzma_block_compressed_size(&block, iter.block.unpadded_size);
+  if (ret == LZMA_OK) ret = lzma_block_decoder(&strm, &block);
+  lzma_filters_free(filters, nullptr);
+
+  if (ret != LZMA_OK) throw SourceException("XzSource: Corrupt input");
+
+  strm.next_in = inbuf.get() + block.header_size;
+  strm.avail_in = n - block.header_size;
+  inBlock = true;
+}
+
+size_t XzSource::read(char *buf, size_t len) {
+  if (finished) return 0;
+
+  strm.next_out = reinterpret_cast<uint8_t *>(buf);
+  strm.avail_out = len;
+
+  while (strm.avail_out > 0) {
+    if (blockMode && !inBlock) {
+      if (lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+        finished = true;
+        break;
+      }
+      initBlock();
+    }
+
+    if (strm.avail_in == 0 && !inputEof) {
+      strm.next_in = inbuf.get();
+      strm.avail_in = readInput();
+    }
+
+    lzma_ret ret =
+        lzma_code(&strm, inputEof && !blockMode ? LZMA_FINISH : LZMA_RUN);
+    if (ret == LZMA_STREAM_END) {
+      if (blockMode) {
+        inBlock = false;
+        continue;
+      }
+      finished = true;
+      break;
+    }
+
+    if (ret == LZMA_BUF_ERROR)
+      throw SourceException("XzSource: Unexpected end of input");
+    if (ret != LZMA_OK) throw SourceException("XzSource: Corrupt input");
+  }
+
+  return len - strm.avail_out;
+}
+
+bool XzSource::takeRestartPoint(uint64_t offset, Checkpoint &cp) {
+  if (nextPoint >= points.size() || points[nextPoint] > offset) return false;
+
+  cp.offset = points[nextPoint++];
+  cp.state.clear();
+  return true;
+}
+
+void XzSource::seek(const Checkpoint &cp) {
+  if (!index || lzma_index_iter_locate(&iter, cp.offset) ||
+      iter.block.uncompressed_file_offset != cp.offset)
+    throw SourceException("XzSource: Invalid restart point");
+
+  initBlock();
+  blockMode = true;
+  finished = false;
+  nextPoint = std::upper_bound(points.begin(), points.end(), cp.offset) -
+              points.begin();
+}
+
+GzipSource::GzipSource(const std::string &filename)
+    : CompressedSource(filename) {
+  memset(&strm, 0, sizeof(strm));
+
+  // 15 + 32 enables automatic gzip header detection
+  if (inflateInit2(&strm, 15 + 32) != Z_OK)
+    throw SourceException("GzipSource: Unable to initialize decoder");
+}
+
+GzipSource::~GzipSource() { inflateEnd(&strm); }
+
+size_t GzipSource::read(char *buf, size_t len) {
+  if (finished) return 0;
+
+  strm.next_out = reinterpret_cast<Bytef *>(buf);
+  strm.avail_out = len > UINT_MAX ? UINT_MAX : len;
+  len = strm.avail_out;
+
+  while (strm.avail_out > 0) {
+    if (strm.avail_in == 0) {
+      strm.next_in = inbuf.get();
+      strm.avail_in = readInput();
+
+      if (strm.avail_in == 0) {
+        if (inMember)
+          throw SourceException("GzipSource: Unexpected end of input");
+        finished = true;
+        break;
+      }
+    }
+
+    // Z_BLOCK stops at every block boundary to find restart points
+    uInt avail = strm.avail_out;
+    int ret = inflate(&strm, Z_BLOCK);
+    outOffset += avail - strm.avail_out;
+
+    if (ret == Z_STREAM_END) {
+      // gzip -d also decompresses concatenated members
+      if (raw) {
+        skipTrailer();
+        inflateReset2(&strm, 15 + 32);
+        raw = false;
+      } else {
+        inflateReset(&strm);
+      }
+      inMember = false;
+      members++;
+    } else if (ret == Z_DATA_ERROR && !inMember && members > 0) {
+      // trailing garbage after the last member is ignored like gzip does
+      finished = true;
+      break;
+    } else if (ret != Z_OK) {
+      throw SourceException("GzipSource: Corrupt input");
+    } else {
+      inMember = true;
+
+      // 128 marks a block boundary and 64 the last block of a member
+      if ((strm.data_type & 128) && !(strm.data_type & 64) &&
+          outOffset >= lastPoint + TIME_INDEX_SPAN)
+        addRestartPoint();
+    }
+  }
+
+  return len - strm.avail_out;
+}
+
+void GzipSource::addRestartPoint() {
+  uint8_t window[32768];
+  uInt windowLen = sizeof(window);
+  uint64_t in = inputOffset - strm.avail_in;
+  uint8_t bits = strm.data_type & 7;
+
+  if (inflateGetDictionary(&strm, window, &windowLen) != Z_OK) return;
+
+  // state: compressed offset, unused bits of the previous byte, window
+  point.offset = outOffset;
+  point.state.assign(reinterpret_cast<char *>(&in), sizeof(in));
+  point.state.push_back(bits);
+  point.state.append(reinterpret_cast<char *>(window), windowLen);
+  hasPoint = true;
+  lastPoint = outOffset;
+}
+
+void GzipSource::skipTrailer() {
+  // CRC32 and ISIZE of the member, which the raw decoder does not check
+  size_t left = 8;
+
+  while (left > 0) {
+    if (strm.avail_in == 0) {
+      strm.next_in = inbuf.get();
+      strm.avail_in = readInput();
+      if (strm.avail_in == 0)
+        throw SourceException("GzipSource: Unexpected end of input");
+    }
+
+    size_t n = std::min<size_t>(left, strm.avail_in);
+    strm.next_in += n;
+    strm.avail_in -= n;
+    left -= n;
+  }
+}
+
+bool GzipSource::takeRestartPoint(uint64_t offset, Checkpoint &cp) {
+  if (!hasPoint || point.offset > offset) return false;
+
+  cp.offset = point.offset;
+  cp.state = std::move(point.state);
+  hasPoint = false;
+  return true;
+}
+
+void GzipSource::seek(const Checkpoint &cp) {
+  uint64_t in;
+
+  if (cp.state.size() <= sizeof(in))
+    throw SourceException("GzipSource: Invalid restart point");
+
+  memcpy(&in, cp.state.data(), sizeof(in));
+  uint8_t bits = cp.state[sizeof(in)];
+  auto window = reinterpret_cast<const Bytef *>(cp.state.data()) +
+                sizeof(in) + 1;
+  uInt windowLen = cp.state.size() - sizeof(in) - 1;
+
+  if (inflateReset2(&strm, -15) != Z_OK)
+    throw SourceException("GzipSource: Unable to initialize decoder");
+
+  // a block can start in the middle of a byte
+  seekInput(bits ? in - 1 : in);
+  strm.next_in = inbuf.get();
+  strm.avail_in = readInput();
+
+  if (bits) {
+    if (strm.avail_in == 0)
+      throw SourceException("GzipSource: Unexpected end of input");
+    inflatePrime(&strm, bits, strm.next_in[0] >> (8 - bits));
+    strm.next_in++;
+    strm.avail_in--;
+  }
+
+  if (inflateSetDictionary(&strm, window, windowLen) != Z_OK)
+    throw SourceException("GzipSource: Invalid restart point");
+
+  raw = true;
+  finished = false;
+  inMember = true;
+  members = 0;
+  outOffset = cp.offset;
+  lastPoint = cp.offset;
+  hasPoint = false;
+}
+
+Bzip2Source::Bzip2Source(const std::string &filename)
+    : CompressedSource(filename) {
+  memset(&strm, 0, sizeof(strm));
+  init();
+}
+
+Bzip2Source::~Bzip2Source() { BZ2_bzDecompressEnd(&strm); }
+
+void Bzip2Source::init() {
+  if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+    throw SourceException("Bzip2Source: Unable to initialize decoder");
+}
+
+size_t Bzip2Source::read(char *buf, size_t len) {
+  if (finished) return 0;
+
+  strm.next_out = buf;
+  strm.avail_out = len > UINT_MAX ? UINT_MAX : len;
+  len = strm.avail_out;
+
+  while (strm.avail_out > 0) {
+    if (strm.avail_in == 0) {
+      strm.next_in = reinterpret_cast<char *>(inbuf.get());
+      strm.avail_in = readInput();
+
+      if (strm.avail_in == 0) {
+        if (inMember)
+          throw SourceException("Bzip2Source: Unexpected end of input");
+        finished = true;
+        break;
+      }
+    }
+
+    unsigned int avail = strm.avail_out;
+    int ret = BZ2_bzDecompress(&strm);
+    outOffset += avail - strm.avail_out;
+
+    if (ret == BZ_STREAM_END) {
+      // multiple streams, e.g. produced by pbzip2
+      char *next_in = strm.next_in;
+      unsigned int avail_in = strm.avail_in;
+      char *next_out = strm.next_out;
+      unsigned int avail_out = strm.avail_out;
+
+      BZ2_bzDecompressEnd(&strm);
+      memset(&strm, 0, sizeof(strm));
+      init();
+
+      strm.next_in = next_in;
+      strm.avail_in = avail_in;
+      strm.next_out = next_out;
+      strm.avail_out = avail_out;
+      inMember = false;
+      members++;
+
+      if (outOffset >= lastPoint + TIME_INDEX_SPAN) {
+        uint64_t in = inputOffset - avail_in;
+
+        point.offset = outOffset;
+        point.state.assign(reinterpret_cast<char *>(&in), sizeof(in));
+        hasPoint = true;
+        lastPoint = outOffset;
+      }
+    } else if (ret == BZ_DATA_ERROR_MAGIC && !inMember && members > 0) {
+      // trailing garbage after the last stream
+      finished = true;
+      break;
+    } else if (ret != BZ_OK) {
+      throw SourceException("Bzip2Source: Corrupt input");
+    } else {
+      inMember = true;
+    }
+  }
+
+  return len - strm.avail_out;
+}
+
+bool Bzip2Source::takeRestartPoint(uint64_t offset, Checkpoint &cp) {
+  if (!hasPoint || point.offset > offset) return false;
+
+  cp.offset = point.offset;
+  cp.state = std::move(point.state);
+  hasPoint = false;
+  return true;
+}
+
+void Bzip2Source::seek(const Checkpoint &cp) {
+  uint64_t in;
+
+  if (cp.state.size() != sizeof(in))
+    throw SourceException("Bzip2Source: Invalid restart point");
+  memcpy(&in, cp.state.data(), sizeof(in));
+
+  BZ2_bzDecompressEnd(&strm);
+  memset(&strm, 0, sizeof(strm));
+  init();
+  seekInput(in);
+
+  // restart points always follow a complete stream
+  finished = false;
+  inMember = false;
+  members = 1;
+  outOffset = cp.offset;
+  lastPoint = cp.offset;
+  hasPoint = false;
+}
+
+}  // namespace input
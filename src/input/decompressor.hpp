@@ -0,0 +1,163 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUT_DECOMPRESSOR_H_
+#define INPUT_DECOMPRESSOR_H_
+
+#include <bzlib.h>
+#include <lzma.h>
+#include <zlib.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "input/source.hpp"
+
+namespace input {
+
+/*
+ * size of the buffer for the compressed input
+ */
+#define COMPRESSED_BUF_SIZE (1024 * 1024)
+
+/*
+ * Common part of the decompressing sources. Reads the compressed
+ * file in large chunks into an internal buffer.
+ */
+class CompressedSource : public Source {
+ private:
+  int fd;
+
+ protected:
+  std::unique_ptr<uint8_t[]> inbuf;
+  bool inputEof = false;
+  // file offset of the end of the data in inbuf
+  uint64_t inputOffset = 0;
+  uint64_t inputSize = 0;
+
+  // returns the number of bytes read into inbuf
+  size_t readInput();
+  // the next readInput() starts at offset
+  void seekInput(uint64_t offset);
+
+ public:
+  explicit CompressedSource(const std::string &filename);
+  ~CompressedSource() override;
+
+  CompressedSource(const CompressedSource &) = delete;
+  CompressedSource &operator=(const CompressedSource &) = delete;
+};
+
+/*
+ * Restart points of xz files are block boundaries taken from the
+ * index at the end of each stream. After a seek the blocks are
+ * decoded individually, so files compressed as a single block
+ * (the default of single-threaded xz) cannot be seeked.
+ */
+class XzSource : public CompressedSource {
+ private:
+  lzma_stream strm = LZMA_STREAM_INIT;
+  lzma_index *index = nullptr;
+  lzma_index_iter iter;
+  // the block decoder keeps a pointer to the current block
+  lzma_block block;
+  std::vector<uint64_t> points;
+  size_t nextPoint = 0;
+  bool finished = false;
+  bool blockMode = false;
+  bool inBlock = false;
+
+  void loadIndex();
+  void initBlock();
+
+ public:
+  explicit XzSource(const std::string &filename);
+  ~XzSource() override;
+
+  size_t read(char *buf, size_t len) override;
+
+  [[nodiscard]] bool seekable() const override { return index != nullptr; }
+  bool takeRestartPoint(uint64_t offset, Checkpoint &cp) override;
+  void seek(const Checkpoint &cp) override;
+};
+
+/*
+ * Restart points of gzip files are deflate block boundaries together
+ * with the last 32KiB of output, which is needed as dictionary to
+ * continue decoding there (the method of zran.c in the zlib sources).
+ */
+class GzipSource : public CompressedSource {
+ private:
+  z_stream strm;
+  bool finished = false;
+  bool inMember = false;
+  // decoding a raw deflate stream after a seek
+  bool raw = false;
+  uint64_t members = 0;
+  uint64_t outOffset = 0;
+  uint64_t lastPoint = 0;
+  Checkpoint point;
+  bool hasPoint = false;
+
+  void addRestartPoint();
+  void skipTrailer();
+
+ public:
+  explicit GzipSource(const std::string &filename);
+  ~GzipSource() override;
+
+  size_t read(char *buf, size_t len) override;
+
+  [[nodiscard]] bool seekable() const override { return true; }
+  bool takeRestartPoint(uint64_t offset, Checkpoint &cp) override;
+  void seek(const Checkpoint &cp) override;
+};
+
+/*
+ * bzip2 blocks are not byte aligned and libbz2 cannot resume inside
+ * of a stream, so the only restart points are the stream boundaries
+ * of files with multiple streams (e.g. created by pbzip2).
+ */
+class Bzip2Source : public CompressedSource {
+ private:
+  bz_stream strm;
+  bool finished = false;
+  bool inMember = false;
+  uint64_t members = 0;
+  uint64_t outOffset = 0;
+  uint64_t lastPoint = 0;
+  Checkpoint point;
+  bool hasPoint = false;
+
+  void init();
+
+ public:
+  explicit Bzip2Source(const std::string &filename);
+  ~Bzip2Source() override;
+
+  size_t read(char *buf, size_t len) override;
+
+  [[nodiscard]] bool seekable() const override { return true; }
+  bool takeRestartPoint(uint64_t offset, Checkpoint &cp) override;
+  void seek(const Checkpoint &cp) override;
+};
+
+}  // namespace input
+
+#endif /* INPUT_DECOMPRESSOR_H_ */
@@ -0,0 +1,233 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input/line_reader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace input {
+
+void BufferedLineReader::fill() {
+  // move the incomplete line to the front of the buffer
+  if (start > 0) {
+    memmove(buffer.get(), buffer.get() + start, end - start);
+    end -= start;
+    scanned -= start;
+    bufferOffset += start;
+    start = 0;
+  }
+
+  if (end == capacity) {
+    std::unique_ptr<char[]> tmp(new char[capacity * 2]);
+    memcpy(tmp.get(), buffer.get(), end);
+    buffer = std::move(tmp);
+    capacity *= 2;
+  }
+
+  size_t ret = source->read(buffer.get() + end, capacity - end);
+  if (ret == 0) eof = true;
+
+  end += ret;
+}
+
+bool BufferedLineReader::readLine(std::string_view &line) {
+  while (true) {
+    char *buf = buffer.get();
+    auto nl = static_cast<char *>(memchr(buf + scanned, '\n', end - scanned));
+
+    if (nl) {
+      line = std::string_view(buf + start, nl - buf - start);
+      lineOffset = bufferOffset + start;
+      start = scanned = nl - buf + 1;
+      return true;
+    }
+
+    scanned = end;
+
+    if (eof) {
+      if (start == end) return false;
+
+      // last line without a trailing newline
+      line = std::string_view(buf + start, end - start);
+      lineOffset = bufferOffset + start;
+      start = scanned = end;
+      return true;
+    }
+
+    fill();
+  }
+}
+
+bool BufferedLineReader::readChunk(std::string_view &chunk,
+                                   size_t maxSize) {
+  while (!eof && end - start < maxSize) fill();
+
+  while (true) {
+    char *buf = buffer.get();
+    size_t limit = std::min(end, start + maxSize);
+    auto nl = static_cast<char *>(memrchr(buf + start, '\n', limit - start));
+
+    // a single line longer than maxSize
+    if (!nl) nl = static_cast<char *>(memchr(buf + limit, '\n', end - limit));
+
+    if (nl || (eof && start < end)) {
+      size_t len = nl ? nl - buf + 1 - start : end - start;
+      chunk = std::string_view(buf + start, len);
+      lineOffset = bufferOffset + start;
+      start = scanned = start + len;
+      return true;
+    }
+
+    if (eof) return false;
+
+    fill();
+  }
+}
+
+bool BufferedLineReader::takeCheckpoint(Checkpoint &cp) {
+  if (!source->takeRestartPoint(lineOffset, cp)) return false;
+
+  cp.skip = lineOffset - cp.offset;
+  return true;
+}
+
+void BufferedLineReader::seek(const Checkpoint &cp) {
+  source->seek(cp);
+
+  start = end = scanned = 0;
+  eof = false;
+  bufferOffset = lineOffset = cp.offset;
+
+  // drop the rest of the line the restart point is in
+  uint64_t skip = cp.skip;
+  while (skip > 0) {
+    if (start == end) {
+      if (eof) break;
+      fill();
+      continue;
+    }
+
+    size_t n = std::min<uint64_t>(skip, end - start);
+    start = scanned = start + n;
+    skip -= n;
+  }
+}
+
+MappedLineReader::MappedLineReader(const std::string &filename) {
+  struct stat st;
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw Source::SourceException(std::string("Unable to open file: ") +
+                                  strerror(errno));
+
+  if (fstat(fd, &st)) {
+    close(fd);
+    throw Source::SourceException(std::string("Unable to stat file: ") +
+                                  strerror(errno));
+  }
+
+  size = st.st_size;
+
+  if (size > 0) {
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+      close(fd);
+      throw Source::SourceException(std::string("Unable to map file: ") +
+                                    strerror(errno));
+    }
+
+    data = static_cast<const char *>(ptr);
+    madvise(ptr, size, MADV_SEQUENTIAL);
+  }
+
+  // the mapping stays valid after closing the file
+  close(fd);
+}
+
+MappedLineReader::~MappedLineReader() {
+  if (data) munmap(const_cast<char *>(data), size);
+}
+
+bool MappedLineReader::readLine(std::string_view &line) {
+  if (pos == size) return false;
+
+  auto nl = static_cast<const char *>(memchr(data + pos, '\n', size - pos));
+  size_t len = nl ? nl - (data + pos) : size - pos;
+
+  line = std::string_view(data + pos, len);
+  lineOffset = pos;
+  pos += nl ? len + 1 : len;
+
+  return true;
+}
+
+bool MappedLineReader::readChunk(std::string_view &chunk, size_t maxSize) {
+  if (pos == size) return false;
+
+  size_t len = std::min(maxSize, size - pos);
+  if (pos + len < size) {
+    // cut after the last newline, or after the first one of a long line
+    auto nl = static_cast<const char *>(memrchr(data + pos, '\n', len));
+    if (!nl)
+      nl = static_cast<const char *>(
+          memchr(data + pos + len, '\n', size - pos - len));
+    len = nl ? nl + 1 - (data + pos) : size - pos;
+  }
+
+  chunk = std::string_view(data + pos, len);
+  lineOffset = pos;
+  pos += len;
+
+  return true;
+}
+
+bool MappedLineReader::takeCheckpoint(Checkpoint &cp) {
+  if (lineOffset < lastPoint + TIME_INDEX_SPAN) return false;
+
+  cp.offset = lastPoint = lineOffset;
+  cp.skip = 0;
+  cp.state.clear();
+  return true;
+}
+
+void MappedLineReader::seek(const Checkpoint &cp) {
+  pos = std::min<uint64_t>(cp.offset + cp.skip, size);
+  lineOffset = lastPoint = cp.offset;
+}
+
+std::unique_ptr<LineReader> openInput(const std::string &filename) {
+  struct stat st;
+
+  if (filename != "-" && !stat(filename.c_str(), &st) &&
+      S_ISREG(st.st_mode) && !isCompressed(filename))
+    return std::make_unique<MappedLineReader>(filename);
+
+  return std::make_unique<BufferedLineReader>(openSource(filename));
+}
+
+}  // namespace input
@@ -0,0 +1,138 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUT_LINE_READER_H_
+#define INPUT_LINE_READER_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "input/source.hpp"
+
+namespace input {
+
+/*
+ * initial size of the line buffer, it grows if a
+ * single line does not fit into it
+ */
+#define LINE_BUF_SIZE (4 * 1024 * 1024)
+
+/*
+ * Splits the trace input into lines. The lines are handed out in
+ * place as spans without the trailing newline and are not NUL
+ * terminated. They stay valid until the next call to readLine().
+ */
+class LineReader {
+ public:
+  virtual ~LineReader() = default;
+
+  // returns false at the end of the input
+  virtual bool readLine(std::string_view &line) = 0;
+  /*
+   * Returns the following complete lines with their newlines, at most
+   * maxSize bytes of them, or a single longer line. Unless stableChunks()
+   * is true, the chunk also becomes invalid on the next call.
+   */
+  virtual bool readChunk(std::string_view &chunk, size_t maxSize) = 0;
+  // the chunks stay valid as long as the reader
+  [[nodiscard]] virtual bool stableChunks() const { return false; }
+
+  [[nodiscard]] virtual bool seekable() const { return false; }
+  /*
+   * Returns a new checkpoint, if one is available before the start of
+   * the line or chunk returned last. Only the offset, skip and state
+   * are set.
+   */
+  virtual bool takeCheckpoint(Checkpoint & /*cp*/) { return false; }
+  // the next line returned is the one following the checkpoint
+  virtual void seek(const Checkpoint & /*cp*/) {
+    throw Source::SourceException("LineReader: Seeking is not supported");
+  }
+};
+
+/*
+ * Reads the data of a Source in large blocks into a reusable buffer.
+ */
+class BufferedLineReader : public LineReader {
+ private:
+  std::unique_ptr<Source> source;
+  std::unique_ptr<char[]> buffer;
+  size_t capacity = LINE_BUF_SIZE;
+  // unconsumed data is between start and end
+  size_t start = 0;
+  size_t end = 0;
+  // everything between start and scanned contains no newline
+  size_t scanned = 0;
+  bool eof = false;
+  // input offsets of the buffer and of the line returned last
+  uint64_t bufferOffset = 0;
+  uint64_t lineOffset = 0;
+
+  void fill();
+
+ public:
+  explicit BufferedLineReader(std::unique_ptr<Source> source)
+      : source(std::move(source)), buffer(new char[LINE_BUF_SIZE]) {}
+
+  bool readLine(std::string_view &line) override;
+  bool readChunk(std::string_view &chunk, size_t maxSize) override;
+
+  [[nodiscard]] bool seekable() const override { return source->seekable(); }
+  bool takeCheckpoint(Checkpoint &cp) override;
+  void seek(const Checkpoint &cp) override;
+};
+
+/*
+ * Maps an uncompressed trace file into memory, so the lines and
+ * chunks are handed out without ever copying them.
+ */
+class MappedLineReader : public LineReader {
+ private:
+  const char *data = nullptr;
+  size_t size = 0;
+  size_t pos = 0;
+  size_t lineOffset = 0;
+  size_t lastPoint = 0;
+
+ public:
+  explicit MappedLineReader(const std::string &filename);
+  ~MappedLineReader() override;
+
+  MappedLineReader(const MappedLineReader &) = delete;
+  MappedLineReader &operator=(const MappedLineReader &) = delete;
+
+  bool readLine(std::string_view &line) override;
+  bool readChunk(std::string_view &chunk, size_t maxSize) override;
+  [[nodiscard]] bool stableChunks() const override { return true; }
+
+  [[nodiscard]] bool seekable() const override { return true; }
+  bool takeCheckpoint(Checkpoint &cp) override;
+  void seek(const Checkpoint &cp) override;
+};
+
+/*
+ * Opens the trace input. Regular uncompressed files are mapped into
+ * memory, everything else is read through openSource().
+ */
+std::unique_ptr<LineReader> openInput(const std::string &filename);
+
+}  // namespace input
+
+#endif /* INPUT_LINE_READER_H_ */
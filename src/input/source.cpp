@@ -0,0 +1,92 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input/source.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "input/decompressor.hpp"
+#include "input/tar_source.hpp"
+
+namespace input {
+
+FileSource::FileSource(const std::string &filename) : owned(true) {
+  if ((fd = open(filename.c_str(), O_RDONLY)) == -1)
+    throw SourceException(std::string("Unable to open file: ") +
+                          strerror(errno));
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+FileSource::~FileSource() {
+  if (owned) close(fd);
+}
+
+size_t FileSource::read(char *buf, size_t len) {
+  ssize_t ret;
+
+  do {
+    ret = ::read(fd, buf, len);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret == -1)
+    throw SourceException(std::string("Error reading input: ") +
+                          strerror(errno));
+
+  return ret;
+}
+
+std::string extension(const std::string &filename) {
+  auto pos = filename.rfind('.');
+  return pos == std::string::npos ? "" : filename.substr(pos + 1);
+}
+
+bool isCompressed(const std::string &filename) {
+  std::string ext = extension(filename);
+  return ext == "xz" || ext == "gz" || ext == "bz2";
+}
+
+std::unique_ptr<Source> openSource(const std::string &filename) {
+  struct stat st;
+
+  if (filename == "-") return std::make_unique<FileSource>(STDIN_FILENO);
+
+  if (stat(filename.c_str(), &st))
+    throw Source::SourceException(std::string("Unable to open file: ") +
+                                  strerror(errno));
+
+  // input is a directory of trace archives
+  if (S_ISDIR(st.st_mode)) return std::make_unique<TarSource>(filename);
+
+  std::string ext = extension(filename);
+
+  if (ext == "xz") return std::make_unique<XzSource>(filename);
+  if (ext == "gz") return std::make_unique<GzipSource>(filename);
+  if (ext == "bz2") return std::make_unique<Bzip2Source>(filename);
+
+  return std::make_unique<FileSource>(filename);
+}
+
+}  // namespace input
@@ -0,0 +1,99 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUT_SOURCE_H_
+#define INPUT_SOURCE_H_
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "input/time_index.hpp"
+
+namespace input {
+
+/*
+ * A stream of raw trace data. Compressed inputs are decoded
+ * in-process directly into the buffer supplied by the caller.
+ */
+class Source {
+ public:
+  virtual ~Source() = default;
+
+  /*
+   * reads up to len bytes into buf and returns the number
+   * of bytes read, 0 means end of input
+   */
+  virtual size_t read(char *buf, size_t len) = 0;
+
+  /*
+   * Restart points are positions where decoding can be resumed later.
+   * takeRestartPoint() returns the next one that was not returned yet,
+   * if it lies at or before offset (in decoded bytes). Only the offset
+   * and the state of the checkpoint are filled in.
+   */
+  [[nodiscard]] virtual bool seekable() const { return false; }
+  virtual bool takeRestartPoint(uint64_t /*offset*/, Checkpoint & /*cp*/) {
+    return false;
+  }
+  // continues reading at the restart point of the checkpoint
+  virtual void seek(const Checkpoint & /*cp*/) {
+    throw SourceException("Source: Seeking is not supported");
+  }
+
+  class SourceException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+};
+
+/*
+ * uncompressed input read directly from a file descriptor
+ */
+class FileSource : public Source {
+ private:
+  int fd;
+  bool owned;
+
+ public:
+  explicit FileSource(const std::string &filename);
+  explicit FileSource(int fd) : fd(fd), owned(false) {}
+  ~FileSource() override;
+
+  FileSource(const FileSource &) = delete;
+  FileSource &operator=(const FileSource &) = delete;
+
+  size_t read(char *buf, size_t len) override;
+};
+
+// returns the file extension without the dot
+std::string extension(const std::string &filename);
+
+// true if openSource() decompresses the file
+bool isCompressed(const std::string &filename);
+
+/*
+ * Opens the input depending on the file extension. "-" stands for stdin,
+ * *.xz, *.gz and *.bz2 are decompressed on the fly and a directory is
+ * treated as a set of legacy *.tar trace archives.
+ */
+std::unique_ptr<Source> openSource(const std::string &filename);
+
+}  // namespace input
+
+#endif /* INPUT_SOURCE_H_ */
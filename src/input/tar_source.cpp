@@ -0,0 +1,444 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input/tar_source.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "input/decompressor.hpp"
+
+namespace input {
+
+#define TAR_BLOCK_SIZE 512
+
+// only the trace files inside of the archives are replayed
+#define TAR_MEMBER_PATTERN "*.txt.gz"
+
+// amount of decompressed data searched for the first time stamp
+#define TAR_PEEK_SIZE (64 * 1024)
+
+namespace {
+
+/*
+ * closes the zlib stream if decompression is aborted by an exception
+ */
+struct InflateStream {
+  z_stream strm;
+
+  InflateStream() {
+    memset(&strm, 0, sizeof(strm));
+    // 15 + 32 enables automatic gzip header detection
+    if (inflateInit2(&strm, 15 + 32) != Z_OK)
+      throw Source::SourceException("TarSource: Unable to initialize decoder");
+  }
+
+  ~InflateStream() { inflateEnd(&strm); }
+};
+
+void preadFully(int fd, void *buf, size_t len, uint64_t offset) {
+  auto pos = static_cast<char *>(buf);
+
+  while (len > 0) {
+    ssize_t ret = pread(fd, pos, len, offset);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret == -1)
+      throw Source::SourceException(std::string("Error reading archive: ") +
+                                    strerror(errno));
+    if (ret == 0) throw Source::SourceException("Unexpected end of archive");
+
+    pos += ret;
+    len -= ret;
+    offset += ret;
+  }
+}
+
+uint64_t parseNumber(const char *field, size_t len) {
+  uint64_t res = 0;
+
+  // GNU base-256 encoding for large values
+  if (*field & 0x80) {
+    res = *field & 0x3F;
+    for (size_t i = 1; i < len; ++i)
+      res = (res << 8) | static_cast<uint8_t>(field[i]);
+    return res;
+  }
+
+  for (size_t i = 0; i < len && field[i]; ++i) {
+    if (field[i] >= '0' && field[i] <= '7') res = (res << 3) | (field[i] - '0');
+  }
+
+  return res;
+}
+
+bool checkHeader(const char *header) {
+  unsigned int sum = 0;
+
+  for (int i = 0; i < TAR_BLOCK_SIZE; ++i) {
+    // the checksum field itself counts as spaces
+    if (i >= 148 && i < 156)
+      sum += ' ';
+    else
+      sum += static_cast<uint8_t>(header[i]);
+  }
+
+  return sum == parseNumber(header + 148, 8);
+}
+
+std::string parsePaxPath(const std::string &data) {
+  std::string path;
+  size_t pos = 0;
+
+  // records have the format "len key=value\n"
+  while (pos < data.size()) {
+    char *end;
+    size_t len = strtoul(data.c_str() + pos, &end, 10);
+    if (!len || pos + len > data.size()) break;
+
+    const char *key = end + 1;
+    std::string record(key, data.c_str() + pos + len - 1 - key);
+    if (!record.compare(0, 5, "path=")) path = record.substr(5);
+
+    pos += len;
+  }
+
+  return path;
+}
+
+}  // namespace
+
+TarSource::TarSource(const std::string &dirname) {
+  std::vector<std::string> paths;
+
+  DIR *dir = opendir(dirname.c_str());
+  if (!dir)
+    throw SourceException(std::string("Unable to open directory: ") +
+                          strerror(errno));
+
+  while (struct dirent *ent = readdir(dir)) {
+    if (!fnmatch("*.tar", ent->d_name, FNM_PERIOD))
+      paths.push_back(dirname + '/' + ent->d_name);
+  }
+  closedir(dir);
+
+  if (paths.empty()) throw SourceException("TarSource: No *.tar files found");
+
+  // same order as the shell glob
+  std::sort(paths.begin(), paths.end());
+
+  for (auto &path : paths) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      for (int a : archives) close(a);
+      throw SourceException("Unable to open '" + path +
+                            "': " + strerror(errno));
+    }
+    archives.push_back(fd);
+  }
+
+  try {
+    for (size_t i = 0; i < paths.size(); ++i) listArchive(i, paths[i]);
+
+    /*
+     * Archives are not necessarily named in chronological order,
+     * so the members are sorted by their first time stamp. Members
+     * without one keep their position relative to their predecessor.
+     */
+    double last = -INFINITY;
+    for (auto &m : members) {
+      m.firstTime = peekFirstTime(m);
+      if (std::isnan(m.firstTime)) m.firstTime = last;
+      last = m.firstTime;
+    }
+  } catch (...) {
+    for (int a : archives) close(a);
+    throw;
+  }
+
+  std::stable_sort(members.begin(), members.end(),
+                   [](const Member &a, const Member &b) {
+                     return a.firstTime < b.firstTime;
+                   });
+  states = std::vector<MemberState>(members.size());
+
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, members.size());
+  window = 2 * threads;
+  maxChunks = TAR_CHUNKS_PER_THREAD * threads;
+
+  for (size_t i = 0; i < threads; ++i)
+    workers.emplace_back(&TarSource::work, this);
+}
+
+TarSource::~TarSource() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  workerCond.notify_all();
+
+  for (auto &t : workers) t.join();
+  for (int fd : archives) close(fd);
+}
+
+void TarSource::listArchive(size_t archive, const std::string &path) {
+  int fd = archives[archive];
+  char header[TAR_BLOCK_SIZE];
+  std::string longName;
+  struct stat st;
+
+  if (fstat(fd, &st))
+    throw SourceException(std::string("Unable to stat archive: ") +
+                          strerror(errno));
+
+  uint64_t offset = 0;
+  while (offset + TAR_BLOCK_SIZE <= static_cast<uint64_t>(st.st_size)) {
+    preadFully(fd, header, TAR_BLOCK_SIZE, offset);
+    offset += TAR_BLOCK_SIZE;
+
+    // like tar -i zero blocks are skipped instead of ending the archive
+    if (std::all_of(header, header + TAR_BLOCK_SIZE,
+                    [](char c) { return c == 0; }))
+      continue;
+
+    if (!checkHeader(header))
+      throw SourceException("TarSource: Corrupt header in '" + path + "'");
+
+    uint64_t size = parseNumber(header + 124, 12);
+    char type = header[156];
+
+    if (type == 'L' || type == 'x') {
+      // GNU long name or pax extended header for the next entry
+      std::string data(size, 0);
+      preadFully(fd, &data[0], size, offset);
+      if (type == 'L')
+        longName = data.c_str();
+      else
+        longName = parsePaxPath(data);
+    } else {
+      std::string name;
+      if (!longName.empty()) {
+        name = longName;
+      } else {
+        name.assign(header, strnlen(header, 100));
+        // ustar prefix field
+        if (!memcmp(header + 257, "ustar", 5) && header[345]) {
+          name = std::string(header + 345, strnlen(header + 345, 155)) + '/' +
+                 name;
+        }
+      }
+      longName.clear();
+
+      if ((type == '0' || type == '\0' || type == '7') &&
+          !fnmatch(TAR_MEMBER_PATTERN, name.c_str(), 0)) {
+        members.push_back(Member{archive, offset, size, NAN});
+      }
+    }
+
+    offset += (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+  }
+}
+
+double TarSource::peekFirstTime(const Member &member) {
+  InflateStream s;
+  std::unique_ptr<uint8_t[]> inbuf(new uint8_t[COMPRESSED_BUF_SIZE]);
+  std::unique_ptr<char[]> outbuf(new char[TAR_PEEK_SIZE + 1]);
+
+  size_t len = std::min<uint64_t>(member.size, COMPRESSED_BUF_SIZE);
+  preadFully(archives[member.archive], inbuf.get(), len, member.offset);
+
+  s.strm.next_in = inbuf.get();
+  s.strm.avail_in = len;
+  s.strm.next_out = reinterpret_cast<Bytef *>(outbuf.get());
+  s.strm.avail_out = TAR_PEEK_SIZE;
+
+  int ret;
+  do {
+    ret = inflate(&s.strm, Z_NO_FLUSH);
+  } while (ret == Z_OK && s.strm.avail_in > 0 && s.strm.avail_out > 0);
+
+  char *end = outbuf.get() + TAR_PEEK_SIZE - s.strm.avail_out;
+  *end = 0;
+
+  for (char *line = outbuf.get(); line < end;) {
+    if (isdigit(*line)) return strtod(line, nullptr);
+
+    line = static_cast<char *>(memchr(line, '\n', end - line));
+    if (!line) break;
+    ++line;
+  }
+
+  return NAN;
+}
+
+bool TarSource::pushChunk(size_t idx, Chunk &&chunk) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  workerCond.wait(lock, [&] {
+    return stop || idx == current || bufferedChunks < maxChunks;
+  });
+  if (stop) return false;
+
+  states[idx].chunks.push_back(std::move(chunk));
+  bufferedChunks++;
+
+  if (idx == current) readerCond.notify_one();
+
+  return true;
+}
+
+void TarSource::decompressMember(size_t idx) {
+  const Member &m = members[idx];
+  int fd = archives[m.archive];
+  InflateStream s;
+  std::unique_ptr<uint8_t[]> inbuf(new uint8_t[COMPRESSED_BUF_SIZE]);
+  Chunk chunk{std::unique_ptr<char[]>(new char[TAR_CHUNK_SIZE]), 0};
+  uint64_t pos = 0;
+  bool inStream = false;
+  bool streamEnded = false;
+
+  while (true) {
+    if (s.strm.avail_in == 0) {
+      if (pos == m.size) break;
+
+      size_t len = std::min<uint64_t>(m.size - pos, COMPRESSED_BUF_SIZE);
+      preadFully(fd, inbuf.get(), len, m.offset + pos);
+      pos += len;
+
+      s.strm.next_in = inbuf.get();
+      s.strm.avail_in = len;
+    }
+
+    s.strm.next_out = reinterpret_cast<Bytef *>(chunk.data.get() + chunk.size);
+    s.strm.avail_out = TAR_CHUNK_SIZE - chunk.size;
+
+    int ret = inflate(&s.strm, Z_NO_FLUSH);
+    chunk.size = TAR_CHUNK_SIZE - s.strm.avail_out;
+
+    if (ret == Z_STREAM_END) {
+      // concatenated gzip streams
+      inflateReset(&s.strm);
+      inStream = false;
+      streamEnded = true;
+    } else if (ret == Z_DATA_ERROR && !inStream && streamEnded) {
+      // trailing garbage is ignored like gzip does
+      break;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      throw SourceException("Corrupt member");
+    } else {
+      inStream = true;
+    }
+
+    if (chunk.size == TAR_CHUNK_SIZE) {
+      if (!pushChunk(idx, std::move(chunk))) return;
+      chunk = Chunk{std::unique_ptr<char[]>(new char[TAR_CHUNK_SIZE]), 0};
+    }
+  }
+
+  if (inStream) throw SourceException("Unexpected end of member");
+
+  if (chunk.size) pushChunk(idx, std::move(chunk));
+}
+
+void TarSource::work() {
+  while (true) {
+    size_t idx;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      workerCond.wait(lock, [this] {
+        return stop || next >= members.size() || next < current + window;
+      });
+      if (stop || next >= members.size()) return;
+
+      idx = next++;
+    }
+
+    std::string error;
+    try {
+      decompressMember(idx);
+    } catch (std::exception &e) {
+      error = e.what();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    states[idx].error = error;
+    states[idx].done = true;
+    if (idx == current) readerCond.notify_one();
+  }
+}
+
+size_t TarSource::read(char *buf, size_t len) {
+  std::unique_lock<std::mutex> lock(mutex);
+  size_t total = 0;
+
+  while (total < len && current < members.size()) {
+    MemberState &m = states[current];
+
+    if (m.chunks.empty() && !m.done) {
+      // hand out what we have instead of waiting
+      if (total > 0) break;
+      readerCond.wait(lock, [&] { return !m.chunks.empty() || m.done; });
+    }
+
+    if (m.chunks.empty()) {
+      if (!m.error.empty()) throw SourceException("TarSource: " + m.error);
+
+      current++;
+      chunkPos = 0;
+      workerCond.notify_all();
+      continue;
+    }
+
+    // references to deque elements stay valid while workers append
+    Chunk &chunk = m.chunks.front();
+    size_t n = std::min(len - total, chunk.size - chunkPos);
+
+    lock.unlock();
+    memcpy(buf + total, chunk.data.get() + chunkPos, n);
+    lock.lock();
+
+    total += n;
+    chunkPos += n;
+
+    if (chunkPos == chunk.size) {
+      m.chunks.pop_front();
+      chunkPos = 0;
+      bufferedChunks--;
+      workerCond.notify_all();
+    }
+  }
+
+  return total;
+}
+
+}  // namespace input
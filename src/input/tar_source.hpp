@@ -0,0 +1,115 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUT_TAR_SOURCE_H_
+#define INPUT_TAR_SOURCE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "input/source.hpp"
+
+namespace input {
+
+/*
+ * size of the chunks the tar members are decompressed into
+ */
+#define TAR_CHUNK_SIZE (4 * 1024 * 1024)
+
+/*
+ * Maximum number of decompressed chunks per worker thread buffered ahead
+ * of the reader. The member that is currently read may exceed this
+ * limit, otherwise the workers could deadlock.
+ */
+#define TAR_CHUNKS_PER_THREAD 4
+
+/*
+ * Reads a directory of legacy trace archives (*.tar files containing
+ * *.txt.gz members). The members of all archives are listed up front,
+ * ordered by the time stamp of their first line and decompressed by
+ * several worker threads at once. The data is delivered strictly in
+ * member order.
+ */
+class TarSource : public Source {
+ private:
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  struct Member {
+    size_t archive;
+    uint64_t offset;
+    uint64_t size;
+    double firstTime;
+  };
+
+  // decompression state of a member shared with the worker threads
+  struct MemberState {
+    std::deque<Chunk> chunks;
+    bool done = false;
+    std::string error;
+  };
+
+  std::vector<int> archives;
+  std::vector<Member> members;
+  std::vector<MemberState> states;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable workerCond;
+  std::condition_variable readerCond;
+  // index of the member that is currently read
+  size_t current = 0;
+  // index of the next member a worker starts to decompress
+  size_t next = 0;
+  // members decompressed at once
+  size_t window;
+  size_t bufferedChunks = 0;
+  size_t maxChunks;
+  bool stop = false;
+
+  // read position in the front chunk of the current member
+  size_t chunkPos = 0;
+
+  void listArchive(size_t archive, const std::string &path);
+  double peekFirstTime(const Member &member);
+  void decompressMember(size_t idx);
+  // returns false if the source is shutting down
+  bool pushChunk(size_t idx, Chunk &&chunk);
+  void work();
+
+ public:
+  explicit TarSource(const std::string &dirname);
+  ~TarSource() override;
+
+  TarSource(const TarSource &) = delete;
+  TarSource &operator=(const TarSource &) = delete;
+
+  size_t read(char *buf, size_t len) override;
+};
+
+}  // namespace input
+
+#endif /* INPUT_TAR_SOURCE_H_ */
@@ -0,0 +1,184 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input/time_index.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace input {
+
+#define TIME_INDEX_MAGIC "NFSRIDX"
+#define TIME_INDEX_VERSION 1
+
+namespace {
+
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t traceSize;
+  int64_t traceMtime;
+  int64_t firstTime;
+  uint64_t count;
+};
+
+struct IndexEntry {
+  uint64_t offset;
+  uint64_t skip;
+  int64_t maxTime;
+  uint64_t lines;
+  uint64_t stateLen;
+};
+
+}  // namespace
+
+TimeIndex::TimeIndex(const std::string &traceFile) {
+  struct stat st;
+
+  // without a regular file there is nothing to index
+  if (stat(traceFile.c_str(), &st)) return;
+
+  path = traceFile;
+  if (path.back() == '/') path.pop_back();
+  path += ".idx";
+
+  traceSize = st.st_size;
+  traceMtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+  load();
+}
+
+TimeIndex::~TimeIndex() {
+  // the index is only an optimization, errors are ignored
+  try {
+    save();
+  } catch (...) {
+  }
+}
+
+void TimeIndex::load() {
+  IndexHeader header;
+  std::vector<Checkpoint> tmp;
+
+  FILE *in = fopen(path.c_str(), "r");
+  if (!in) return;
+
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, TIME_INDEX_MAGIC, sizeof(TIME_INDEX_MAGIC)) ||
+      header.version != TIME_INDEX_VERSION || header.traceSize != traceSize ||
+      header.traceMtime != traceMtime) {
+    fclose(in);
+    return;
+  }
+
+  for (uint64_t i = 0; i < header.count; ++i) {
+    IndexEntry entry;
+    Checkpoint cp;
+
+    if (fread(&entry, sizeof(entry), 1, in) != 1) break;
+
+    cp.offset = entry.offset;
+    cp.skip = entry.skip;
+    cp.maxTime = entry.maxTime;
+    cp.lines = entry.lines;
+    cp.state.resize(entry.stateLen);
+
+    if (entry.stateLen &&
+        fread(&cp.state[0], 1, entry.stateLen, in) != entry.stateLen)
+      break;
+
+    tmp.push_back(std::move(cp));
+  }
+
+  fclose(in);
+
+  // a truncated index is discarded completely
+  if (tmp.size() != header.count) return;
+
+  checkpoints = std::move(tmp);
+  firstTime = header.firstTime;
+}
+
+void TimeIndex::setFirstTime(int64_t time) {
+  if (path.empty() || firstTime == time) return;
+
+  firstTime = time;
+  dirty = true;
+}
+
+void TimeIndex::add(Checkpoint &&cp) {
+  if (path.empty() ||
+      (!checkpoints.empty() && checkpoints.back().offset >= cp.offset))
+    return;
+
+  checkpoints.push_back(std::move(cp));
+  dirty = true;
+}
+
+const Checkpoint *TimeIndex::find(int64_t time) const {
+  // maxTime never decreases from one checkpoint to the next
+  auto it = std::upper_bound(
+      checkpoints.begin(), checkpoints.end(), time,
+      [](int64_t t, const Checkpoint &cp) { return t < cp.maxTime; });
+
+  if (it == checkpoints.begin()) return nullptr;
+
+  return &*(it - 1);
+}
+
+void TimeIndex::save() {
+  if (!dirty) return;
+
+  std::string tmpPath = path + ".tmp";
+  FILE *out = fopen(tmpPath.c_str(), "w");
+  if (!out) return;
+
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TIME_INDEX_MAGIC, sizeof(TIME_INDEX_MAGIC));
+  header.version = TIME_INDEX_VERSION;
+  header.traceSize = traceSize;
+  header.traceMtime = traceMtime;
+  header.firstTime = firstTime;
+  header.count = checkpoints.size();
+
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+  for (auto &cp : checkpoints) {
+    if (!ok) break;
+
+    IndexEntry entry{cp.offset, cp.skip, cp.maxTime, cp.lines,
+                     cp.state.size()};
+    ok = fwrite(&entry, sizeof(entry), 1, out) == 1 &&
+         fwrite(cp.state.data(), 1, cp.state.size(), out) == cp.state.size();
+  }
+
+  if (fclose(out) || !ok || rename(tmpPath.c_str(), path.c_str())) {
+    remove(tmpPath.c_str());
+    return;
+  }
+
+  dirty = false;
+}
+
+}  // namespace input
@@ -0,0 +1,91 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUT_TIME_INDEX_H_
+#define INPUT_TIME_INDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace input {
+
+/*
+ * minimum distance between two checkpoints in the input
+ */
+#define TIME_INDEX_SPAN (64 * 1024 * 1024)
+
+/*
+ * A position in the trace input where reading can be resumed.
+ */
+struct Checkpoint {
+  // offset in the uncompressed input or in the binary trace
+  uint64_t offset = 0;
+  // bytes from offset to the start of the next complete line
+  uint64_t skip = 0;
+  // highest frame time stamp before the checkpoint
+  int64_t maxTime = 0;
+  // number of trace lines before the checkpoint
+  uint64_t lines = 0;
+  // decoder state needed to resume, e.g. the deflate window
+  std::string state;
+};
+
+/*
+ * Sidecar index (<trace>.idx) mapping trace time to checkpoints. It is
+ * filled while the trace is read and reused by later runs to skip
+ * straight to the replay start. The index is discarded if the size or
+ * modification time of the trace does not match anymore.
+ */
+class TimeIndex {
+ private:
+  std::string path;
+  uint64_t traceSize = 0;
+  int64_t traceMtime = 0;
+  int64_t firstTime = -1;
+  std::vector<Checkpoint> checkpoints;
+  bool dirty = false;
+
+  void load();
+
+ public:
+  explicit TimeIndex(const std::string &traceFile);
+  ~TimeIndex();
+
+  TimeIndex(const TimeIndex &) = delete;
+  TimeIndex &operator=(const TimeIndex &) = delete;
+
+  // time stamp of the first frame or -1 if unknown
+  [[nodiscard]] int64_t getFirstTime() const { return firstTime; }
+  void setFirstTime(int64_t time);
+
+  // checkpoints have to be added in input order
+  void add(Checkpoint &&cp);
+
+  /*
+   * returns the last checkpoint that does not skip any frame
+   * with a time stamp later than time or nullptr
+   */
+  [[nodiscard]] const Checkpoint *find(int64_t time) const;
+
+  void save();
+};
+
+}  // namespace input
+
+#endif /* INPUT_TIME_INDEX_H_ */
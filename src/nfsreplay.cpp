@@ -25,11 +25,13 @@
 #include <csignal>
 #include <cstdio>
 #include <cstring>
+#include <memory>
 #include <string>
 
 #include "display/console_display.hpp"
 #include "display/logger.hpp"
-#include "parser/parser.hpp"
+#include "parser/binary_trace.hpp"
+#include "parser/frame_reader.hpp"
 #include "replay/transaction_mgr.hpp"
 #include "settings.hpp"
 #include "stats.hpp"
@@ -38,20 +40,28 @@ using namespace std;
 
 #define NFSREPLAY_USAGE                            \
   "Usage: %s [options] [nfs trace file]\n"         \
+  "       %s convert [nfs trace file] [output]\n"  \
   "  -b yyyy-mm-dd\tdate to begin the replay\n"    \
+  "  -c\t\tcoalesce sequential writes\n"           \
   "  -d\t\tenable debug output\n"                  \
   "  -D\t\tuse fdatasync\n"                        \
   "  -g\t\tenable gc for unused nodes (default)\n" \
   "  -G\t\tdisable gc for unused nodes\n"          \
   "  -h\t\tdisplay this help and exit\n"           \
   "  -i\t\tinode test (create empty files)\n"      \
+  "  -j threads\tnumber of parser threads\n"       \
+  "\t\t(defaults to the number of cores)\n"        \
   "  -l yyyy-mm-dd\tstop at limit\n"               \
+  "  -m megabytes\tmemory limit of the tree\n"     \
+  "\t\t(spills cold directories to disk)\n"       \
   "  -r path\twrite report at the end\n"           \
   "  -s minutes\tinterval to sync according\n"     \
   "\t\tto nfs frame time (defaults to 10)\n"       \
   "  -S\t\tdisable syncing\n"                      \
   "  -t\t\tdisplay current time (default)\n"       \
   "  -T\t\tdon't display current time\n"           \
+  "  -u depth\tqueue writes and getattrs in\n"     \
+  "\t\tan io_uring of the given depth\n"           \
   "  -z\t\twrite only zeros (default is random data)\n"
 
 void handler(int sig) {
@@ -77,69 +87,10 @@ void sigint_handler(int) {
   if (pauseExecution == 0) pauseExecution = 1;
 }
 
-static FILE *openInputFile(char *filename) {
-  struct stat st;
-  FILE *res = nullptr;
-
-  if (!strcmp(filename, "-")) return stdin;
-
-  if (stat(filename, &st)) return nullptr;
-
-  /*
-   * child processes inherit this so
-   * we have to set it before the
-   * call to popen, otherwise Ctrl+C
-   * will be propagated to the child
-   * processes
-   */
-  signal(SIGINT, SIG_IGN);
-
-  if (st.st_mode & S_IFDIR) {
-    // input is a directory
-    string command = "cat ";
-    command += filename;
-    if (filename[strlen(filename) - 1] != '/') command += '/';
-    // the -i switch tells tar to ignore EOF
-    command +=
-        "*.tar | tar --to-stdout -i --wildcards -xf "
-        " - \"*.txt.gz\" | gzip -d -c";
-    res = popen(command.c_str(), "r");
-  } else {
-    // is a file
-    char *ext = filename;
-    while (*ext != 0) ext++;
-
-    while (*ext != '.' && ext > filename) ext--;
-
-    if (*ext == '.') ext++;
-
-    if (!strcmp("xz", ext)) {
-      string command = "xz -d -c ";
-      command += filename;
-      res = popen(command.c_str(), "r");
-    } else if (!strcmp("gz", ext)) {
-      string command = "gzip -d -c ";
-      command += filename;
-      res = popen(command.c_str(), "r");
-    } else if (!strcmp("bz2", ext)) {
-      string command = "bzip2 -k -d -c ";
-      command += filename;
-      res = popen(command.c_str(), "r");
-    } else {
-      res = fopen(filename, "r");
-    }
-  }
-
-  // use Ctrl+C for pause
-  signal(SIGINT, sigint_handler);
-
-  return res;
-}
-
 static int parseParams(int argc, char **argv, Settings &sett) {
   int c;
 
-  while ((c = getopt(argc, argv, "dDzs:ShitTb:l:gGr:")) != -1) {
+  while ((c = getopt(argc, argv, "cdDzs:ShitTb:l:m:gGr:j:u:")) != -1) {
     switch (c) {
       case 'z':
         // write only zeros
@@ -153,20 +104,41 @@ static int parseParams(int argc, char **argv, Settings &sett) {
         }
         break;
       }
+      case 'j': {
+        int tmp = atoi(optarg);
+        if (tmp > 0) {
+          sett.parseThreads = tmp;
+        }
+        break;
+      }
       case 'b':
         sett.setStartTime(optarg);
         break;
       case 'l':
         sett.setEndTime(optarg);
         break;
+      case 'm': {
+        long long tmp = atoll(optarg);
+        if (tmp > 0) {
+          sett.memoryLimit = tmp * 1024 * 1024;
+        }
+        break;
+      }
       case 'r':
         sett.reportPath = optarg;
         break;
+      case 'u': {
+        int tmp = atoi(optarg);
+        if (tmp > 0) {
+          sett.ringDepth = tmp;
+        }
+        break;
+      }
       case 'S':
         sett.noSync = true;
         break;
       case 'h':
-        printf(NFSREPLAY_USAGE, argv[0]);
+        printf(NFSREPLAY_USAGE, argv[0], argv[0]);
         return EXIT_FAILURE;
       case 'i':
         sett.inodeTest = true;
@@ -184,6 +156,9 @@ static int parseParams(int argc, char **argv, Settings &sett) {
       case 'D':
         sett.dataSync = true;
         break;
+      case 'c':
+        sett.coalesceWrites = true;
+        break;
       case 'g':
         sett.enableGC = true;
         break;
@@ -191,7 +166,8 @@ static int parseParams(int argc, char **argv, Settings &sett) {
         sett.enableGC = false;
         break;
       case '?':
-        if (optopt == 's' || optopt == 'b')
+        if (optopt == 's' || optopt == 'b' || optopt == 'j' || optopt == 'm' ||
+            optopt == 'u')
           fprintf(stderr, "Option -%c requires an argument.\n", optopt);
         else if (isprint(optopt))
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -206,28 +182,63 @@ static int parseParams(int argc, char **argv, Settings &sett) {
   return EXIT_SUCCESS;
 }
 
+/*
+ * Parses a text trace once and writes the frames
+ * in the binary format, which is much faster to replay
+ */
+static int convert(int argc, char **argv) {
+  if (argc != 4) {
+    printf(NFSREPLAY_USAGE, argv[0], argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    auto reader = parser::openFrameReader(argv[2], 0, true);
+    parser::BinaryTraceWriter writer(argv[3]);
+    unsigned long long frames = 0;
+
+    while (auto frame = reader->read()) {
+      frame->decode();
+      writer.write(*frame, reader->getLines());
+      frames++;
+    }
+
+    writer.close(reader->getLines());
+    printf("Converted %llu lines into %llu frames\n", reader->getLines(),
+           frames);
+  } catch (exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv) {
   int ret = EXIT_SUCCESS;
-  char line[1024];
-  FILE *input;
+  unique_ptr<parser::FrameReader> input;
   Settings sett;
   Stats stats;
 
   signal(SIGSEGV, handler);
+  // use Ctrl+C for pause
+  signal(SIGINT, sigint_handler);
   // use c locale important for parsing numbers
   setlocale(LC_ALL, "C");
 
+  if (argc > 1 && !strcmp(argv[1], "convert")) return convert(argc, argv);
+
   if (parseParams(argc, argv, sett) == EXIT_FAILURE) return EXIT_FAILURE;
 
   if (argc - optind > 0) {
-    input = openInputFile(argv[optind]);
-    if (!input) {
-      fprintf(stderr, "Unable to open '%s': %s\n", argv[optind],
-              strerror(errno));
+    try {
+      input = parser::openFrameReader(argv[optind], sett.parseThreads);
+    } catch (exception &e) {
+      fprintf(stderr, "Unable to open '%s': %s\n", argv[optind], e.what());
       return EXIT_FAILURE;
     }
   } else {
-    printf(NFSREPLAY_USAGE, argv[0]);
+    printf(NFSREPLAY_USAGE, argv[0], argv[0]);
     return EXIT_FAILURE;
   }
 
@@ -240,16 +251,20 @@ int main(int argc, char **argv) {
   Logger logger;
   replay::TransactionMgr transMgr(sett, stats, logger);
   display::ConsoleDisplay disp(sett, stats, transMgr, logger);
-  parser::Parser parser;
 
   try {
-    while (fgets(line, sizeof(line), input) != nullptr) {
-      stats.linesRead++;
+    // frames before the start time are only fast forwarded, so skip
+    // them if the trace was already indexed by an earlier run
+    if (sett.startTime < 0 && sett.startAfterDays > 0 &&
+        input->getFirstTime() >= 0)
+      sett.startTime =
+          input->getFirstTime() + (sett.startAfterDays * 24 * 60 * 60);
 
-      if (!*line) continue;
+    if (sett.startTime >= 0 && input->seek(sett.startTime))
+      logger.log("Skipped to the last checkpoint before the start time");
 
-      auto frame = parser.parse(line);
-      if (!frame) continue;
+    while (auto frame = input->read()) {
+      stats.linesRead = input->getLines();
 
       if (pauseExecution == 1) {
         if (disp.pause()) {
@@ -265,6 +280,7 @@ int main(int argc, char **argv) {
       if (transMgr.process(std::move(frame))) break;
     }
 
+    stats.linesRead = input->getLines();
     stats.writeReport(sett.reportPath);
   } catch (exception &e) {
     disp.destroy();
@@ -272,7 +288,7 @@ int main(int argc, char **argv) {
     ret = EXIT_FAILURE;
   }
 
-  fclose(input);
+  input.reset();
   close(sett.syncFd);
   remove(".sync_file_handle");
 
@@ -0,0 +1,323 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parser/binary_trace.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace parser {
+
+// buffer size of the output stream
+#define BINARY_TRACE_BUF_SIZE (4 * 1024 * 1024)
+
+BinaryTraceWriter::BinaryTraceWriter(const std::string &filename) {
+  if (!(out = fopen(filename.c_str(), "w")))
+    throw BinaryTraceException(std::string("Unable to open output: ") +
+                               strerror(errno));
+
+  setvbuf(out, nullptr, _IOFBF, BINARY_TRACE_BUF_SIZE);
+
+  /*
+   * Placeholder until close() writes the real header. It has the magic
+   * already, so the reader reports an aborted conversion as incomplete
+   * instead of taking the file for a text trace.
+   */
+  BinaryTraceHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC));
+  header.version = BINARY_TRACE_VERSION;
+  header.frameSize = sizeof(BinaryFrame);
+  writeData(&header, sizeof(header));
+  if (fflush(out)) throw BinaryTraceException("Error writing output");
+}
+
+BinaryTraceWriter::~BinaryTraceWriter() {
+  if (out) fclose(out);
+}
+
+void BinaryTraceWriter::writeData(const void *data, size_t len) {
+  if (fwrite(data, 1, len, out) != len)
+    throw BinaryTraceException("Error writing output");
+}
+
+uint32_t BinaryTraceWriter::internName(const Name &name) {
+  if (name.empty()) return 0;
+
+  auto res = names.emplace(name, names.size() + 1);
+  if (res.second) nameTable.push_back(name);
+
+  return res.first->second;
+}
+
+uint32_t BinaryTraceWriter::internHandle(const FileHandle &fh) {
+  if (fh.empty()) return 0;
+
+  auto res = handles.emplace(fh, handles.size() + 1);
+  if (res.second) handleTable.push_back(fh);
+
+  return res.first->second;
+}
+
+void BinaryTraceWriter::write(const Frame &frame, unsigned long long lines) {
+  BinaryFrame rec;
+  memset(&rec, 0, sizeof(rec));
+
+  rec.time = frame.time;
+  rec.atime = frame.atime;
+  rec.mtime = frame.mtime;
+  rec.size = frame.size;
+  rec.offset = frame.offset;
+  rec.fh = internHandle(frame.fh);
+  rec.fh2 = internHandle(frame.fh2);
+  rec.xid = frame.xid;
+  rec.client = frame.client;
+  rec.count = frame.count;
+  rec.mode = frame.mode;
+  rec.name = internName(frame.name);
+  rec.name2 = internName(frame.name2);
+  rec.lines = lines - lastLines;
+  rec.protocol = frame.protocol;
+  rec.operation = frame.operation;
+  rec.status = frame.status;
+  rec.ftype = frame.ftype;
+  rec.truncated = frame.truncated;
+
+  writeData(&rec, sizeof(rec));
+  lastLines = lines;
+  frames++;
+}
+
+void BinaryTraceWriter::close(unsigned long long lines) {
+  BinaryTraceHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC));
+  header.version = BINARY_TRACE_VERSION;
+  header.frameSize = sizeof(BinaryFrame);
+  header.frames = frames;
+  header.namesOffset = sizeof(header) + frames * sizeof(BinaryFrame);
+  header.lines = lines;
+
+  uint64_t offset = header.namesOffset;
+  for (auto &name : nameTable) {
+    uint32_t len = name.size();
+    writeData(&len, sizeof(len));
+    writeData(name.c_str(), len);
+    offset += sizeof(len) + len;
+  }
+
+  header.handlesOffset = offset;
+  for (auto &fh : handleTable) {
+    std::string_view key = fh.key();
+    uint32_t len = key.size();
+    writeData(&len, sizeof(len));
+    writeData(key.data(), len);
+  }
+
+  if (fseek(out, 0, SEEK_SET))
+    throw BinaryTraceException(std::string("Error writing output: ") +
+                               strerror(errno));
+  writeData(&header, sizeof(header));
+
+  FILE *tmp = out;
+  out = nullptr;
+
+  if (fclose(tmp))
+    throw BinaryTraceException(std::string("Error writing output: ") +
+                               strerror(errno));
+}
+
+bool BinaryTraceReader::isBinaryTrace(const std::string &filename) {
+  char magic[sizeof(BINARY_TRACE_MAGIC)];
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+
+  bool res = ::read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+             !memcmp(magic, BINARY_TRACE_MAGIC, sizeof(magic));
+  close(fd);
+
+  return res;
+}
+
+BinaryTraceReader::BinaryTraceReader(const std::string &filename) {
+  struct stat st;
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw BinaryTraceException(std::string("Unable to open file: ") +
+                               strerror(errno));
+
+  if (fstat(fd, &st) || st.st_size < (off_t)sizeof(BinaryTraceHeader)) {
+    close(fd);
+    throw BinaryTraceException("BinaryTraceReader: Invalid file");
+  }
+
+  size = st.st_size;
+  void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (ptr == MAP_FAILED)
+    throw BinaryTraceException(std::string("Unable to map file: ") +
+                               strerror(errno));
+
+  data = static_cast<const char *>(ptr);
+
+  auto header = reinterpret_cast<const BinaryTraceHeader *>(data);
+  if (memcmp(header->magic, BINARY_TRACE_MAGIC, sizeof(BINARY_TRACE_MAGIC)) ||
+      header->version != BINARY_TRACE_VERSION ||
+      header->frameSize != sizeof(BinaryFrame)) {
+    munmap(ptr, size);
+    throw BinaryTraceException(
+        "BinaryTraceReader: Unsupported version, convert the trace again");
+  }
+
+  if (header->namesOffset == 0 || header->namesOffset > size ||
+      header->handlesOffset < header->namesOffset ||
+      header->handlesOffset > size ||
+      header->frames >
+          (header->namesOffset - sizeof(*header)) / sizeof(BinaryFrame)) {
+    munmap(ptr, size);
+    throw BinaryTraceException("BinaryTraceReader: Incomplete file");
+  }
+
+  frames = reinterpret_cast<const BinaryFrame *>(data + sizeof(*header));
+  frameCount = header->frames;
+  totalLines = header->lines;
+
+  try {
+    readNames(header->namesOffset, header->handlesOffset);
+    readHandles(header->handlesOffset);
+  } catch (...) {
+    munmap(ptr, size);
+    throw;
+  }
+
+  madvise(ptr, size, MADV_SEQUENTIAL);
+}
+
+BinaryTraceReader::~BinaryTraceReader() {
+  munmap(const_cast<char *>(data), size);
+}
+
+void BinaryTraceReader::readNames(uint64_t offset, uint64_t end) {
+  names.emplace_back();
+
+  while (offset < end) {
+    uint32_t len;
+
+    if (end - offset < sizeof(len))
+      throw BinaryTraceException("BinaryTraceReader: Truncated name table");
+    memcpy(&len, data + offset, sizeof(len));
+    offset += sizeof(len);
+
+    if (end - offset < len)
+      throw BinaryTraceException("BinaryTraceReader: Truncated name table");
+    names.emplace_back(std::string_view(data + offset, len));
+    offset += len;
+  }
+}
+
+void BinaryTraceReader::readHandles(uint64_t offset) {
+  handles.emplace_back();
+
+  while (offset < size) {
+    uint32_t len;
+
+    if (size - offset < sizeof(len))
+      throw BinaryTraceException("BinaryTraceReader: Truncated handle table");
+    memcpy(&len, data + offset, sizeof(len));
+    offset += sizeof(len);
+
+    if (size - offset < len)
+      throw BinaryTraceException("BinaryTraceReader: Truncated handle table");
+    handles.push_back(
+        FileHandle::fromKey(std::string_view(data + offset, len)));
+    offset += len;
+  }
+}
+
+Name BinaryTraceReader::getName(uint32_t id) const {
+  if (id >= names.size())
+    throw BinaryTraceException("BinaryTraceReader: Invalid name id");
+
+  return names[id];
+}
+
+FileHandle BinaryTraceReader::getHandle(uint32_t id) const {
+  if (id >= handles.size())
+    throw BinaryTraceException("BinaryTraceReader: Invalid handle id");
+
+  return handles[id];
+}
+
+FramePtr BinaryTraceReader::read() {
+  if (pos >= frameCount) {
+    lines = totalLines;
+    return FramePtr(nullptr);
+  }
+
+  if (pos >= lastPoint + TIME_INDEX_SPAN / sizeof(BinaryFrame)) {
+    input::Checkpoint cp;
+    cp.offset = lastPoint = pos;
+    addCheckpoint(std::move(cp));
+  }
+
+  const BinaryFrame *rec = frames + pos++;
+  auto frame = allocFrame();
+
+  frame->time = rec->time;
+  frame->atime = rec->atime;
+  frame->mtime = rec->mtime;
+  frame->size = rec->size;
+  frame->offset = rec->offset;
+  frame->fh = getHandle(rec->fh);
+  frame->fh2 = getHandle(rec->fh2);
+  frame->xid = rec->xid;
+  frame->client = rec->client;
+  frame->count = rec->count;
+  frame->mode = rec->mode;
+  frame->name = getName(rec->name);
+  frame->name2 = getName(rec->name2);
+  frame->protocol = static_cast<Protocol>(rec->protocol);
+  frame->operation = static_cast<OpId>(rec->operation);
+  frame->status = static_cast<Status>(rec->status);
+  frame->ftype = static_cast<FType>(rec->ftype);
+  frame->truncated = rec->truncated;
+  frame->setDecoded();
+
+  lines += rec->lines;
+  frameRead(*frame);
+  return frame;
+}
+
+void BinaryTraceReader::seekTo(const input::Checkpoint &cp) {
+  if (cp.offset > frameCount)
+    throw BinaryTraceException("BinaryTraceReader: Invalid checkpoint");
+
+  pos = lastPoint = cp.offset;
+}
+
+}  // namespace parser
@@ -0,0 +1,163 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_BINARY_TRACE_H_
+#define PARSER_BINARY_TRACE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "parser/frame.hpp"
+#include "parser/frame_pool.hpp"
+#include "parser/frame_reader.hpp"
+
+namespace parser {
+
+/*
+ * Layout of the binary trace format written by "nfsreplay convert".
+ *
+ * The file starts with a BinaryTraceHeader followed by an array of
+ * BinaryFrame, so the file can be mapped and every frame can be
+ * accessed directly by its index. The name table follows the frames
+ * at namesOffset and the file handle table follows the names at
+ * handlesOffset. Every entry consists of the length as uint32_t and
+ * the characters of the name or the key of the file handle.
+ *
+ * Names and file handles are interned: frames refer to them by their
+ * position in the table starting at 1, 0 stands for no name or handle.
+ * The header is written last, so namesOffset is 0 if the conversion did
+ * not finish.
+ */
+#define BINARY_TRACE_MAGIC "NFSRBIN"
+#define BINARY_TRACE_VERSION 3
+
+struct BinaryTraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t frameSize;
+  uint64_t frames;
+  uint64_t namesOffset;
+  uint64_t handlesOffset;
+  // total number of trace lines
+  uint64_t lines;
+};
+
+struct BinaryFrame {
+  int64_t time;
+  int64_t atime;
+  int64_t mtime;
+  uint64_t size;
+  uint64_t offset;
+  uint32_t fh;
+  uint32_t fh2;
+  uint32_t xid;
+  uint32_t client;
+  uint32_t count;
+  uint32_t mode;
+  uint32_t name;
+  uint32_t name2;
+  // trace lines consumed for this frame
+  uint32_t lines;
+  uint8_t protocol;
+  uint8_t operation;
+  uint8_t status;
+  uint8_t ftype;
+  uint8_t truncated;
+  uint8_t pad[7];
+};
+
+class BinaryTraceWriter {
+ private:
+  FILE *out;
+  std::unordered_map<Name, uint32_t> names;
+  // the interned names in the order of their ids
+  std::vector<Name> nameTable;
+  std::unordered_map<FileHandle, uint32_t> handles;
+  std::vector<FileHandle> handleTable;
+  unsigned long long lastLines = 0;
+  uint64_t frames = 0;
+
+  uint32_t internName(const Name &name);
+  uint32_t internHandle(const FileHandle &fh);
+  void writeData(const void *data, size_t len);
+
+ public:
+  explicit BinaryTraceWriter(const std::string &filename);
+  ~BinaryTraceWriter();
+
+  BinaryTraceWriter(const BinaryTraceWriter &) = delete;
+  BinaryTraceWriter &operator=(const BinaryTraceWriter &) = delete;
+
+  // lines is the total number of trace lines read so far
+  void write(const Frame &frame, unsigned long long lines);
+  void close(unsigned long long lines);
+
+  class BinaryTraceException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+};
+
+class BinaryTraceReader : public FrameReader {
+ private:
+  const char *data = nullptr;
+  size_t size = 0;
+  const BinaryFrame *frames = nullptr;
+  uint64_t frameCount = 0;
+  uint64_t totalLines = 0;
+  uint64_t pos = 0;
+  uint64_t lastPoint = 0;
+  // the ids index into names, id 0 is the empty name
+  std::vector<Name> names;
+  // the ids index into handles, id 0 is the empty handle
+  std::vector<FileHandle> handles;
+
+  void readNames(uint64_t offset, uint64_t end);
+  void readHandles(uint64_t offset);
+  Name getName(uint32_t id) const;
+  FileHandle getHandle(uint32_t id) const;
+
+ protected:
+  void seekTo(const input::Checkpoint &cp) override;
+
+ public:
+  explicit BinaryTraceReader(const std::string &filename);
+  ~BinaryTraceReader() override;
+
+  BinaryTraceReader(const BinaryTraceReader &) = delete;
+  BinaryTraceReader &operator=(const BinaryTraceReader &) = delete;
+
+  static bool isBinaryTrace(const std::string &filename);
+
+  FramePtr read() override;
+
+  [[nodiscard]] bool seekable() const override { return true; }
+
+  class BinaryTraceException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+};
+
+}  // namespace parser
+
+#endif /* PARSER_BINARY_TRACE_H_ */
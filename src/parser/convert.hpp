@@ -0,0 +1,106 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_CONVERT_H_
+#define PARSER_CONVERT_H_
+
+#include <cstdint>
+#include <string_view>
+
+namespace parser {
+
+/*
+ * Number conversion on tokens that are not NUL terminated. They behave
+ * like strtoull, i.e. conversion stops at the first invalid character
+ * and the result saturates on overflow.
+ */
+
+inline int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+inline bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+// skips leading white space and the sign like strtoull
+inline size_t skipSign(std::string_view token, bool &negative) {
+  size_t i = 0;
+
+  while (i < token.size() && isSpace(token[i])) i++;
+
+  negative = false;
+  if (i < token.size() && (token[i] == '-' || token[i] == '+')) {
+    negative = token[i] == '-';
+    i++;
+  }
+
+  return i;
+}
+
+/*
+ * len is set to the number of characters consumed,
+ * it is 0 if the token does not start with a number
+ */
+inline uint64_t parseHex(std::string_view token, size_t *len = nullptr) {
+  uint64_t res = 0;
+  bool overflow = false;
+  bool negative;
+  size_t i = skipSign(token, negative);
+
+  // optional 0x prefix like strtoull accepts it
+  if (token.size() > i + 2 && token[i] == '0' && (token[i + 1] | 0x20) == 'x' &&
+      hexValue(token[i + 2]) >= 0)
+    i += 2;
+
+  size_t digits = i;
+  for (; i < token.size(); ++i) {
+    int v = hexValue(token[i]);
+    if (v < 0) break;
+    if (res > (UINT64_MAX >> 4)) overflow = true;
+    res = (res << 4) | v;
+  }
+
+  if (len) *len = i > digits ? i : 0;
+  if (overflow) return UINT64_MAX;
+
+  return negative ? -res : res;
+}
+
+inline uint64_t parseDec(std::string_view token) {
+  uint64_t res = 0;
+  bool overflow = false;
+  bool negative;
+  size_t i = skipSign(token, negative);
+
+  for (; i < token.size(); ++i) {
+    char c = token[i];
+    if (c < '0' || c > '9') break;
+    if (res > (UINT64_MAX - (c - '0')) / 10) overflow = true;
+    res = res * 10 + (c - '0');
+  }
+
+  if (overflow) return UINT64_MAX;
+
+  return negative ? -res : res;
+}
+
+}  // namespace parser
+
+#endif /* PARSER_CONVERT_H_ */
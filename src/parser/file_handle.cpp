@@ -0,0 +1,221 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parser/file_handle.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "parser/convert.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FILEHANDLE_X86
+#include <immintrin.h>
+#endif
+
+namespace parser {
+
+namespace {
+
+inline uint64_t mix(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+// the old value was the sum of the 16 digit chunks of the hex token
+uint64_t legacyValue(std::string_view key) {
+  uint64_t res = 0;
+
+  if (key[0] == FileHandle::KIND_HEX) {
+    for (size_t pos = 1; pos < key.size(); pos += 8) {
+      uint64_t chunk = 0;
+      for (size_t i = pos; i < key.size() && i < pos + 8; ++i)
+        chunk = (chunk << 8) | static_cast<uint8_t>(key[i]);
+      res += chunk;
+    }
+  } else {
+    for (size_t pos = 1; pos < key.size(); pos += 16)
+      res += parseHex(key.substr(pos, 16));
+  }
+
+  return res ? res : 1;
+}
+
+#ifdef FILEHANDLE_X86
+
+// decodes 16 hex digits into 8 bytes
+__attribute__((target("sse2"))) bool decodeHex16(const char *in, char *out) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+
+  // unsigned x < n is min(x, n - 1) == x
+  __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+  __m128i isDigit =
+      _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i letter = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                                _mm_set1_epi8('a'));
+  __m128i isLetter =
+      _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+  if (_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xFFFF)
+    return false;
+
+  __m128i nibbles = _mm_or_si128(
+      _mm_and_si128(isDigit, digit),
+      _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+
+  // every 16 bit lane holds the high nibble in its low byte
+  __m128i bytes = _mm_or_si128(
+      _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0xFF)), 4),
+      _mm_srli_epi16(nibbles, 8));
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                   _mm_packus_epi16(bytes, bytes));
+
+  return true;
+}
+
+#endif /* FILEHANDLE_X86 */
+
+// returns false if the token is not a hex number with whole bytes
+bool decodeHex(std::string_view token, char *out) {
+  size_t i = 0;
+
+  if (token.size() % 2 || token.size() > 2 * FH_MAX_SIZE) return false;
+
+#ifdef FILEHANDLE_X86
+  for (; i + 16 <= token.size(); i += 16)
+    if (!decodeHex16(token.data() + i, out + i / 2)) return false;
+#endif
+
+  for (; i < token.size(); i += 2) {
+    int hi = hexValue(token[i]);
+    int lo = hexValue(token[i + 1]);
+    if (hi < 0 || lo < 0) return false;
+    out[i / 2] = static_cast<char>(hi << 4 | lo);
+  }
+
+  return true;
+}
+
+InternTable handleTable;
+
+/*
+ * The old values of all handles in an open addressing table, 0 marks an
+ * empty slot. Old values are never 0.
+ */
+struct LegacyTable {
+  std::mutex mutex;
+  std::vector<uint64_t> slots = std::vector<uint64_t>(1024);
+  size_t used = 0;
+  uint64_t collisions = 0;
+
+  void add(uint64_t value) {
+    if (2 * (used + 1) > slots.size()) {
+      std::vector<uint64_t> old(2 * slots.size());
+      old.swap(slots);
+      used = 0;
+      for (uint64_t v : old)
+        if (v) add(v);
+    }
+
+    size_t mask = slots.size() - 1;
+    size_t i = mix(value) & mask;
+
+    for (; slots[i]; i = (i + 1) & mask) {
+      if (slots[i] == value) {
+        collisions++;
+        return;
+      }
+    }
+
+    slots[i] = value;
+    used++;
+  }
+};
+
+LegacyTable legacyTable;
+
+}  // namespace
+
+const InternKey *FileHandle::intern(std::string_view key) {
+  bool inserted;
+  const InternKey *res = handleTable.intern(key, &inserted);
+
+  if (inserted) {
+    std::lock_guard<std::mutex> lock(legacyTable.mutex);
+    legacyTable.add(legacyValue(key));
+  }
+
+  return res;
+}
+
+FileHandle &FileHandle::operator=(std::string_view token) {
+  char buf[1 + FH_MAX_SIZE];
+
+  if (token.empty()) {
+    handle = nullptr;
+  } else if (decodeHex(token, buf + 1)) {
+    buf[0] = KIND_HEX;
+    handle = intern(std::string_view(buf, 1 + token.size() / 2));
+  } else {
+    handle = intern(std::string(1, KIND_TEXT).append(token));
+  }
+
+  return *this;
+}
+
+FileHandle FileHandle::fromKey(std::string_view key) {
+  FileHandle res;
+  if (!key.empty()) res.handle = intern(key);
+  return res;
+}
+
+uint64_t FileHandle::count() { return handleTable.size(); }
+
+uint64_t FileHandle::memory() {
+  std::lock_guard<std::mutex> lock(legacyTable.mutex);
+  return handleTable.memory() +
+         legacyTable.slots.size() * sizeof(legacyTable.slots[0]);
+}
+
+uint64_t FileHandle::legacyCollisions() {
+  std::lock_guard<std::mutex> lock(legacyTable.mutex);
+  return legacyTable.collisions;
+}
+
+FileHandle::operator std::string() const {
+  static const char digits[] = "0123456789abcdef";
+  std::string_view k = key();
+  std::string res;
+
+  if (k.empty()) return res;
+  if (k[0] != KIND_HEX) return std::string(k.substr(1));
+
+  for (char c : k.substr(1)) {
+    res.push_back(digits[static_cast<uint8_t>(c) >> 4]);
+    res.push_back(digits[c & 0xF]);
+  }
+
+  return res;
+}
+
+}  // namespace parser
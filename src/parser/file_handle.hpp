@@ -19,81 +19,84 @@
 #ifndef FILEHANDLE_H_
 #define FILEHANDLE_H_
 
-#include <cstdio>
-#include <cstring>
+#include <cstdint>
 #include <functional>
 #include <string>
+#include <string_view>
+
+#include "parser/intern.hpp"
 
 namespace parser {
 
-class FileHandleInt {
+/*
+ * maximum size of a decoded handle, NFSv3 handles are at most 64 bytes
+ * and NFSv4 handles at most 128 bytes
+ */
+#define FH_MAX_SIZE 128
+
+/*
+ * A file handle refers to its interned key, so handles are compared by
+ * pointer and the hash is computed only once per distinct handle. The
+ * first byte of the key is the kind of the key and the rest are the
+ * decoded bytes of a hex handle or the characters of any other token.
+ * The keys are never freed, they take about 60 bytes per distinct
+ * handle.
+ */
+class FileHandle {
  private:
-  uint64_t handle = 0;
+  const InternKey *handle = nullptr;
+
+  static const InternKey *intern(std::string_view key);
+
+  // names may stand for a handle
+  friend class Name;
 
  public:
-  bool operator==(const FileHandleInt &other) const {
+  enum Kind : char { KIND_HEX = 'x', KIND_TEXT = 't' };
+
+  bool operator==(const FileHandle &other) const {
     return handle == other.handle;
   }
 
-  bool operator!=(const FileHandleInt &other) const {
+  bool operator!=(const FileHandle &other) const {
     return handle != other.handle;
   }
 
-  FileHandleInt &operator=(char *token) {
-    /*
-     * the nfs_handle is usually 64 bytes long,
-     * but most of it is constant, because the device id
-     * and other constants rarely change
-     *
-     * the constant parts always add up to the same value
-     * the variable parts like inode number should fit into 64 bits
-     */
-    char tmp;
-    char *tmp2, *tokptr = token;
-    uint64_t res = 0;
-
-    while (*tokptr) {
-      tmp = tokptr[16];
-      tokptr[16] = 0;
-      res += strtoull(tokptr, &tmp2, 16);
-      tokptr[16] = tmp;
-      tokptr = tmp2;
-    }
-
-    // res added up to 0 by accident, but 0 is not allowed
-    if (!res && tokptr != token) res = 1;
-
-    handle = res;
-
-    return *this;
+  // decodes the hex token of a trace
+  FileHandle &operator=(std::string_view token);
+
+  // the handle with the given key as returned by key()
+  static FileHandle fromKey(std::string_view key);
+
+  [[nodiscard]] bool empty() const { return handle == nullptr; }
+  void clear() { handle = nullptr; }
+
+  [[nodiscard]] std::string_view key() const {
+    return handle ? handle->key() : std::string_view();
   }
 
-  [[nodiscard]] bool empty() const { return handle == 0; }
-  void clear() { handle = 0; }
+  [[nodiscard]] size_t hash() const { return handle ? handle->hash : 0; }
+
+  // number of distinct handles seen so far
+  static uint64_t count();
+  // bytes taken by the handles seen so far
+  static uint64_t memory();
+  // distinct handles that had the value of another one under the old scheme
+  static uint64_t legacyCollisions();
 
   /*
    * conversion operator to std::string
    */
-  operator std::string() const {
-    char hexString[2 * sizeof(uint64_t) + 3];
-    // returns decimal value of hex
-    sprintf(hexString, "0x%lX", handle);
-    return hexString;
-  }
-
-  friend struct std::hash<FileHandleInt>;
+  operator std::string() const;
 };
 
-// typedef std::string FileHandle;
-using FileHandle = FileHandleInt;
-
 }  // namespace parser
 
 namespace std {
 template <>
-struct hash<parser::FileHandleInt> {
-  std::size_t operator()(parser::FileHandleInt const &h) const {
-    return std::hash<uint64_t>()(h.handle);
+struct hash<parser::FileHandle> {
+  std::size_t operator()(parser::FileHandle const &h) const {
+    return h.hash();
   }
 };
 }  // namespace std
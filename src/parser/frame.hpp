@@ -19,13 +19,19 @@
 #ifndef FRAME_H_
 #define FRAME_H_
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
+#include "parser/convert.hpp"
 #include "parser/file_handle.hpp"
+#include "parser/name.hpp"
+#include "parser/perfect_hash.hpp"
+#include "parser/tokenizer.hpp"
 
 namespace parser {
 
-enum Protocol { NOPROT, R2, C2, R3, C3 };
+enum Protocol : uint8_t { NOPROT, R2, C2, R3, C3 };
 
 enum FType {
   NOFILE = 0,
@@ -38,7 +44,7 @@ enum FType {
   FIFO = 7
 };
 
-enum OpId {
+enum OpId : uint8_t {
   NULLOP = 0,
   GETATTR = 1,
   SETATTR = 2,
@@ -63,37 +69,108 @@ enum OpId {
   COMMIT = 21
 };
 
-enum Status { FSENT = 0, FOK, FERROR };
+enum Status : uint8_t { FSENT = 0, FOK, FERROR };
 
-class Frame {
+// the operations the replay looks at, it drops all others unseen
+inline bool isReplayed(OpId op) {
+  switch (op) {
+    case GETATTR:
+    case SETATTR:
+    case LOOKUP:
+    case ACCESS:
+    case WRITE:
+    case CREATE:
+    case MKDIR:
+    case SYMLINK:
+    case REMOVE:
+    case RMDIR:
+    case RENAME:
+    case LINK:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// attributes of a frame that are stored, aliases map to the same value
+enum Attribute {
+  ATTR_NONE,
+  ATTR_COUNT,
+  ATTR_NAME,
+  ATTR_SIZE,
+  ATTR_FTYPE,
+  ATTR_OFFSET,
+  ATTR_FH,
+  ATTR_FH2,
+  ATTR_NAME2,
+  ATTR_MODE,
+  ATTR_ATIME,
+  ATTR_MTIME
+};
+
+inline constexpr PerfectHash<Attribute, 64>::Entry attributeKeys[] = {
+    {"count", ATTR_COUNT},
+    {"tcount", ATTR_COUNT},
+    {"name", ATTR_NAME},
+    {"fn", ATTR_NAME},
+    {"size", ATTR_SIZE},
+    {"ftype", ATTR_FTYPE},
+    {"off", ATTR_OFFSET},
+    {"offset", ATTR_OFFSET},
+    {"fh", ATTR_FH},
+    {"fh2", ATTR_FH2},
+    {"fn2", ATTR_NAME2},
+    {"name2", ATTR_NAME2},
+    {"sdata", ATTR_NAME2},
+    {"mode", ATTR_MODE},
+    {"atime", ATTR_ATIME},
+    {"mtime", ATTR_MTIME}};
+
+inline constexpr PerfectHash<Attribute, 64> attributes(attributeKeys,
+                                                       ATTR_NONE);
+
+/*
+ * The header fields and the raw attributes fit into the first cache
+ * line. The attributes are only decoded by decode(), which is skipped
+ * for the many frames the replay throws away without looking at them.
+ */
+class alignas(64) Frame {
  private:
+  bool decoded;
   bool size_occured;
 
  public:
+  // header, always valid
+  int64_t time;
+  // transaction id
+  uint32_t xid;
+  uint32_t client;
   Protocol protocol;
   OpId operation;
   Status status;
-  // transaction id
-  uint32_t xid;
-  int64_t time;
-  int64_t atime;
-  int64_t mtime;
 
-  uint32_t client;
-  bool truncated;
+  // the attribute tokens of the trace line
+  std::string raw;
 
-  // attributes
+  // attributes, valid after decode()
+  bool truncated;
   uint32_t count;
-  uint64_t size;
   uint32_t mode;
+  uint64_t size;
   uint64_t offset;
+  int64_t atime;
+  int64_t mtime;
   FileHandle fh;
   FileHandle fh2;
-  std::string name;
-  std::string name2;
+  Name name;
+  Name name2;
   FType ftype;
 
-  Frame() {
+  Frame() { clear(); }
+
+  // resets all fields, the raw string keeps its storage for reuse
+  void clear() {
+    decoded = false;
     ftype = NOFILE;
     protocol = NOPROT;
     operation = NULLOP;
@@ -109,43 +186,97 @@ class Frame {
     size_occured = false;
     mode = 0;
     offset = 0;
+    raw.clear();
     name.clear();
     name2.clear();
     fh.clear();
     fh2.clear();
   }
 
-  void setAttribute(const char *name, char *token) {
-    if (!count && (!strcmp(name, "count") || !strcmp(name, "tcount"))) {
-      count = strtoul(token, nullptr, 16);
-    } else if (this->name.empty() &&
-               (!strcmp(name, "name") || !strcmp(name, "fn"))) {
-      this->name = token;
-    } else if (!size_occured && !strcmp(name, "size")) {
-      // only read first size
-      size_occured = true;
-      size = strtoull(token, nullptr, 16);
-    } else if (ftype == NOFILE && !strcmp(name, "ftype")) {
-      // only read first ftype
-      ftype = (FType)atoi(token);
-    } else if (!strcmp(token, "LONGPKT")) {
+  // decodes the raw attributes once
+  void decode() {
+    thread_local Tokenizer tokenizer;
+
+    if (decoded) return;
+    decoded = true;
+
+    // every token is the key of the following one
+    auto &tokens = tokenizer.tokenize(raw);
+    for (size_t i = 1; i < tokens.size(); ++i)
+      setAttribute(tokens[i - 1], tokens[i]);
+  }
+
+  // the attributes were set directly instead of from raw
+  void setDecoded() {
+    decoded = true;
+    raw.clear();
+  }
+
+  void setAttribute(std::string_view name, std::string_view token) {
+    Attribute attr = attributes.find(name);
+
+    // the first attributes take precedence over LONGPKT
+    switch (attr) {
+      case ATTR_COUNT:
+        if (!count) {
+          count = parseHex(token);
+          return;
+        }
+        break;
+      case ATTR_NAME:
+        if (this->name.empty()) {
+          this->name = token;
+          return;
+        }
+        break;
+      case ATTR_SIZE:
+        // only read first size
+        if (!size_occured) {
+          size_occured = true;
+          size = parseHex(token);
+          return;
+        }
+        break;
+      case ATTR_FTYPE:
+        // only read first ftype
+        if (ftype == NOFILE) {
+          ftype = (FType)parseDec(token);
+          return;
+        }
+        break;
+      default:
+        break;
+    }
+
+    if (token == "LONGPKT") {
       truncated = true;
-    } else if (!offset && (!strcmp(name, "off") || !strcmp(name, "offset"))) {
-      offset = strtoull(token, nullptr, 16);
-    } else if (fh.empty() && !strcmp(name, "fh")) {
-      fh = token;
-    } else if (fh2.empty() && !strcmp(name, "fh2")) {
-      fh2 = token;
-    } else if (name2.empty() &&
-               (!strcmp(name, "fn2") || !strcmp(name, "name2") ||
-                !strcmp(name, "sdata"))) {
-      name2 = token;
-    } else if (!mode && !strcmp(name, "mode")) {
-      mode = 0x1FF & strtoul(token, nullptr, 16);
-    } else if (!atime && !strcmp(name, "atime")) {
-      atime = strtoull(token, nullptr, 10);
-    } else if (!mtime && !strcmp(name, "mtime")) {
-      mtime = strtoull(token, nullptr, 10);
+      return;
+    }
+
+    switch (attr) {
+      case ATTR_OFFSET:
+        if (!offset) offset = parseHex(token);
+        break;
+      case ATTR_FH:
+        if (fh.empty()) fh = token;
+        break;
+      case ATTR_FH2:
+        if (fh2.empty()) fh2 = token;
+        break;
+      case ATTR_NAME2:
+        if (name2.empty()) name2 = token;
+        break;
+      case ATTR_MODE:
+        if (!mode) mode = 0x1FF & parseHex(token);
+        break;
+      case ATTR_ATIME:
+        if (!atime) atime = parseDec(token);
+        break;
+      case ATTR_MTIME:
+        if (!mtime) mtime = parseDec(token);
+        break;
+      default:
+        break;
     }
   }
 };
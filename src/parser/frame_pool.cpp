@@ -0,0 +1,105 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parser/frame_pool.hpp"
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace parser {
+
+namespace {
+
+using FrameBatch = std::vector<Frame *>;
+
+struct SharedPool {
+  std::mutex mutex;
+  std::vector<FrameBatch> batches;
+
+  ~SharedPool() {
+    for (auto &batch : batches)
+      for (Frame *frame : batch) delete frame;
+  }
+
+  FrameBatch take() {
+    std::lock_guard<std::mutex> lock(mutex);
+    FrameBatch batch;
+
+    if (!batches.empty()) {
+      batch = std::move(batches.back());
+      batches.pop_back();
+    }
+
+    return batch;
+  }
+
+  void give(FrameBatch &&batch) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (batches.size() < FRAME_POOL_MAX_BATCHES) {
+        batches.push_back(std::move(batch));
+        return;
+      }
+    }
+
+    for (Frame *frame : batch) delete frame;
+  }
+};
+
+SharedPool sharedPool;
+
+struct LocalCache {
+  FrameBatch frames;
+
+  // the frames of exiting threads go back to the shared pool
+  ~LocalCache() {
+    if (!frames.empty()) sharedPool.give(std::move(frames));
+  }
+};
+
+thread_local LocalCache localCache;
+
+}  // namespace
+
+void FrameDeleter::operator()(const Frame *frame) const {
+  FrameBatch &frames = localCache.frames;
+
+  frames.push_back(const_cast<Frame *>(frame));
+
+  if (frames.size() >= 2 * FRAME_POOL_BATCH) {
+    FrameBatch batch(frames.end() - FRAME_POOL_BATCH, frames.end());
+    frames.resize(frames.size() - FRAME_POOL_BATCH);
+    sharedPool.give(std::move(batch));
+  }
+}
+
+FramePtr allocFrame() {
+  FrameBatch &frames = localCache.frames;
+
+  if (frames.empty()) frames = sharedPool.take();
+  if (frames.empty()) return FramePtr(new Frame());
+
+  Frame *frame = frames.back();
+  frames.pop_back();
+  frame->clear();
+
+  return FramePtr(frame);
+}
+
+}  // namespace parser
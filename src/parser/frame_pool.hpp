@@ -0,0 +1,59 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_FRAME_POOL_H_
+#define PARSER_FRAME_POOL_H_
+
+#include <memory>
+
+#include "parser/frame.hpp"
+
+namespace parser {
+
+/*
+ * number of frames moved between a thread and the shared pool at once
+ */
+#define FRAME_POOL_BATCH 256
+
+/*
+ * maximum number of batches kept in the shared pool, frames
+ * released beyond that are freed
+ */
+#define FRAME_POOL_MAX_BATCHES 1024
+
+// returns the frame to the pool instead of freeing it
+struct FrameDeleter {
+  void operator()(const Frame *frame) const;
+};
+
+using FramePtr = std::unique_ptr<Frame, FrameDeleter>;
+using ConstFramePtr = std::unique_ptr<const Frame, FrameDeleter>;
+
+/*
+ * Returns a cleared frame. Frames are recycled through a small cache
+ * per thread and a shared pool, which moves them in batches from the
+ * thread that releases them (the replay) to the threads that allocate
+ * them (the parsers). Names and handles are interned, so only the raw
+ * attributes of a recycled frame keep their buffer, and in the steady
+ * state parsing a line does not allocate at all.
+ */
+FramePtr allocFrame();
+
+}  // namespace parser
+
+#endif /* PARSER_FRAME_POOL_H_ */
@@ -0,0 +1,93 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parser/frame_reader.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "input/line_reader.hpp"
+#include "parser/binary_trace.hpp"
+#include "parser/parallel_reader.hpp"
+
+namespace parser {
+
+void FrameReader::addCheckpoint(input::Checkpoint &&cp) {
+  if (!index) return;
+
+  cp.maxTime = maxTime;
+  cp.lines = lines;
+  index->add(std::move(cp));
+}
+
+void FrameReader::frameRead(const Frame &frame) {
+  if (firstFrame) {
+    if (index) index->setFirstTime(frame.time);
+    firstFrame = false;
+  }
+
+  maxTime = std::max(maxTime, frame.time);
+}
+
+void FrameReader::setIndex(std::unique_ptr<input::TimeIndex> index) {
+  this->index = std::move(index);
+}
+
+int64_t FrameReader::getFirstTime() const {
+  return index ? index->getFirstTime() : -1;
+}
+
+bool FrameReader::seek(int64_t time) {
+  if (!index) return false;
+
+  const input::Checkpoint *cp = index->find(time);
+  if (!cp || cp->lines <= lines) return false;
+
+  seekTo(*cp);
+  lines = cp->lines;
+  maxTime = cp->maxTime;
+  firstFrame = false;
+
+  return true;
+}
+
+std::unique_ptr<FrameReader> openFrameReader(const std::string &filename,
+                                             unsigned threads,
+                                             bool allOperations) {
+  std::unique_ptr<FrameReader> reader;
+
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+
+  if (BinaryTraceReader::isBinaryTrace(filename))
+    reader = std::make_unique<BinaryTraceReader>(filename);
+  else if (threads > 1)
+    reader = std::make_unique<ParallelFrameReader>(input::openInput(filename),
+                                                   threads, allOperations);
+  else
+    reader = std::make_unique<TextFrameReader>(input::openInput(filename),
+                                               allOperations);
+
+  if (filename != "-" && reader->seekable())
+    reader->setIndex(std::make_unique<input::TimeIndex>(filename));
+
+  return reader;
+}
+
+}  // namespace parser
@@ -0,0 +1,133 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_FRAME_READER_H_
+#define PARSER_FRAME_READER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "input/line_reader.hpp"
+#include "input/time_index.hpp"
+#include "parser/frame.hpp"
+#include "parser/frame_pool.hpp"
+#include "parser/parser.hpp"
+
+namespace parser {
+
+/*
+ * Produces the frames of a trace in order. Seekable readers fill a
+ * TimeIndex with checkpoints while reading, which allows later runs
+ * to skip everything before the start time of the replay.
+ */
+class FrameReader {
+ private:
+  std::unique_ptr<input::TimeIndex> index;
+  bool firstFrame = true;
+
+ protected:
+  unsigned long long lines = 0;
+  // highest time stamp read so far
+  int64_t maxTime = INT64_MIN;
+
+  // has to be called before the lines of the next frame are counted
+  void addCheckpoint(input::Checkpoint &&cp);
+  // has to be called for every frame returned by read()
+  void frameRead(const Frame &frame);
+  virtual void seekTo(const input::Checkpoint & /*cp*/) {}
+
+ public:
+  virtual ~FrameReader() = default;
+
+  // returns nullptr at the end of the input
+  virtual FramePtr read() = 0;
+
+  // number of trace lines consumed so far
+  [[nodiscard]] unsigned long long getLines() const { return lines; }
+
+  [[nodiscard]] virtual bool seekable() const { return false; }
+  void setIndex(std::unique_ptr<input::TimeIndex> index);
+  [[nodiscard]] bool hasIndex() const { return index != nullptr; }
+
+  // time stamp of the first frame of the trace or -1 if unknown
+  [[nodiscard]] int64_t getFirstTime() const;
+
+  /*
+   * Skips to the last checkpoint before any frame later than time.
+   * Returns false if the index does not contain such a checkpoint.
+   */
+  bool seek(int64_t time);
+};
+
+/*
+ * Parses the frames from the text format of the traces. Only the frames
+ * the replay looks at keep their attributes, unless allOperations is set.
+ */
+class TextFrameReader : public FrameReader {
+ private:
+  std::unique_ptr<input::LineReader> input;
+  Parser parser;
+
+ protected:
+  void seekTo(const input::Checkpoint &cp) override { input->seek(cp); }
+
+ public:
+  explicit TextFrameReader(std::unique_ptr<input::LineReader> input,
+                           bool allOperations = false)
+      : input(std::move(input)), parser(allOperations) {}
+
+  FramePtr read() override {
+    std::string_view line;
+    input::Checkpoint cp;
+
+    while (input->readLine(line)) {
+      if (hasIndex() && input->takeCheckpoint(cp)) addCheckpoint(std::move(cp));
+
+      lines++;
+
+      if (line.empty()) continue;
+
+      auto frame = parser.parse(line);
+      if (frame) {
+        if (parser.keepsAttributes(frame->operation)) frame->decode();
+        frameRead(*frame);
+        return frame;
+      }
+    }
+
+    return FramePtr(nullptr);
+  }
+
+  [[nodiscard]] bool seekable() const override { return input->seekable(); }
+};
+
+/*
+ * Opens a text trace or a trace converted with "nfsreplay convert".
+ * Text traces are parsed on the given number of threads, 0 uses one
+ * thread per core. With allOperations the frames of all operations keep
+ * their attributes, not only the ones the replay looks at.
+ */
+std::unique_ptr<FrameReader> openFrameReader(const std::string &filename,
+                                             unsigned threads = 0,
+                                             bool allOperations = false);
+
+}  // namespace parser
+
+#endif /* PARSER_FRAME_READER_H_ */
@@ -0,0 +1,123 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parser/intern.hpp"
+
+#include <cstring>
+
+namespace parser {
+
+uint64_t internHash(std::string_view key) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ key.size();
+  size_t i = 0;
+
+  for (; i + 8 <= key.size(); i += 8) {
+    uint64_t w;
+    memcpy(&w, key.data() + i, sizeof(w));
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+
+  if (i < key.size()) {
+    uint64_t w = 0;
+    memcpy(&w, key.data() + i, key.size() - i);
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+  }
+
+  // the finalizer of splitmix64
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+InternKey *InternTable::allocate(size_t size) {
+  // room for the NUL character
+  size = (sizeof(InternKey) + size + alignof(InternKey)) &
+         ~(alignof(InternKey) - 1);
+
+  if (size > INTERN_CHUNK_SIZE / 4) {
+    // large keys get a chunk of their own
+    largeKeys.emplace_back(new char[size]);
+    largeBytes += size;
+    return reinterpret_cast<InternKey *>(largeKeys.back().get());
+  }
+
+  if (INTERN_CHUNK_SIZE - chunkPos < size) {
+    chunks.emplace_back(new char[INTERN_CHUNK_SIZE]);
+    chunkPos = 0;
+  }
+
+  char *res = chunks.back().get() + chunkPos;
+  chunkPos += size;
+  return reinterpret_cast<InternKey *>(res);
+}
+
+const InternKey *InternTable::intern(std::string_view key, bool *inserted) {
+  uint64_t hash = internHash(key);
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t mask = slots.size() - 1;
+  size_t i = hash & mask;
+
+  if (inserted) *inserted = false;
+
+  for (; slots[i]; i = (i + 1) & mask)
+    if (slots[i]->hash == hash && slots[i]->key() == key) return slots[i];
+
+  InternKey *res = allocate(key.size());
+  res->hash = hash;
+  res->size = key.size();
+  char *data = const_cast<char *>(res->data());
+  memcpy(data, key.data(), key.size());
+  data[key.size()] = 0;
+
+  // keep the load factor below 1/2
+  if (2 * (used + 1) > slots.size()) {
+    std::vector<const InternKey *> table(2 * slots.size());
+    mask = table.size() - 1;
+
+    for (auto k : slots) {
+      if (!k) continue;
+      for (i = k->hash & mask; table[i];) i = (i + 1) & mask;
+      table[i] = k;
+    }
+    slots.swap(table);
+
+    for (i = hash & mask; slots[i];) i = (i + 1) & mask;
+  }
+
+  slots[i] = res;
+  used++;
+  if (inserted) *inserted = true;
+
+  return res;
+}
+
+uint64_t InternTable::size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return used;
+}
+
+uint64_t InternTable::memory() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return chunks.size() * INTERN_CHUNK_SIZE + largeBytes +
+         slots.size() * sizeof(slots[0]);
+}
+
+}  // namespace parser
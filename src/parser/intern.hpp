@@ -0,0 +1,86 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_INTERN_H_
+#define PARSER_INTERN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace parser {
+
+/*
+ * size of the chunks the interned keys are allocated from
+ */
+#define INTERN_CHUNK_SIZE (1024 * 1024)
+
+/*
+ * An interned key. The characters follow the struct and are terminated
+ * by a NUL character.
+ */
+struct InternKey {
+  uint64_t hash;
+  uint32_t size;
+
+  [[nodiscard]] const char *data() const {
+    return reinterpret_cast<const char *>(this + 1);
+  }
+  [[nodiscard]] std::string_view key() const { return {data(), size}; }
+};
+
+// strong 64 bit hash of a key
+uint64_t internHash(std::string_view key);
+
+/*
+ * Stores every distinct key once, so interned keys are equal if their
+ * pointers are equal. The table uses open addressing with linear
+ * probing and is shared by all threads. Keys are never freed.
+ */
+class InternTable {
+ private:
+  std::mutex mutex;
+  std::vector<const InternKey *> slots;
+  uint64_t used = 0;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  size_t chunkPos = INTERN_CHUNK_SIZE;
+  std::vector<std::unique_ptr<char[]>> largeKeys;
+  uint64_t largeBytes = 0;
+
+  InternKey *allocate(size_t size);
+
+ public:
+  InternTable() : slots(1024) {}
+  InternTable(const InternTable &) = delete;
+  InternTable &operator=(const InternTable &) = delete;
+
+  // inserted is set if the key was not interned before
+  const InternKey *intern(std::string_view key, bool *inserted = nullptr);
+
+  // number of distinct keys
+  uint64_t size();
+  // bytes taken by the keys and the table
+  uint64_t memory();
+};
+
+}  // namespace parser
+
+#endif /* PARSER_INTERN_H_ */
@@ -0,0 +1,49 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parser/name.hpp"
+
+namespace parser {
+
+static InternTable nameTable;
+
+const InternKey *Name::intern(std::string_view name) {
+  return nameTable.intern(name);
+}
+
+Name Name::fromHandle(const FileHandle &fh) {
+  Name res;
+  if (!fh.empty())
+    res.key = reinterpret_cast<const InternKey *>(
+        reinterpret_cast<uintptr_t>(fh.handle) | 1);
+  return res;
+}
+
+std::string Name::str() const {
+  if (!isHandle()) return std::string(view());
+
+  FileHandle fh;
+  fh.handle = untagged();
+  return fh;
+}
+
+uint64_t Name::count() { return nameTable.size(); }
+
+uint64_t Name::memory() { return nameTable.memory(); }
+
+}  // namespace parser
@@ -0,0 +1,108 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_NAME_H_
+#define PARSER_NAME_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "parser/file_handle.hpp"
+#include "parser/intern.hpp"
+
+namespace parser {
+
+/*
+ * A file name interned in a global pool. Equal names share the same
+ * key, so names are compared and hashed by pointer. The pointer order
+ * is stable, but unrelated to the order of the characters.
+ *
+ * A name that stands for the string of a file handle refers to the key
+ * of the handle with the lowest bit of the pointer set instead, so the
+ * unique handles of orphans never end up in the pool. Such a name has
+ * no characters of its own, str() formats them from the handle.
+ */
+class Name {
+ private:
+  const InternKey *key = nullptr;
+
+  static const InternKey *intern(std::string_view name);
+
+  [[nodiscard]] const InternKey *untagged() const {
+    return reinterpret_cast<const InternKey *>(
+        reinterpret_cast<uintptr_t>(key) & ~uintptr_t(1));
+  }
+
+ public:
+  Name() = default;
+  explicit Name(std::string_view name) { *this = name; }
+
+  Name &operator=(std::string_view name) {
+    key = name.empty() ? nullptr : intern(name);
+    return *this;
+  }
+
+  bool operator==(const Name &other) const { return key == other.key; }
+  bool operator!=(const Name &other) const { return key != other.key; }
+  bool operator<(const Name &other) const { return key < other.key; }
+
+  bool operator==(std::string_view other) const { return view() == other; }
+  bool operator!=(std::string_view other) const { return view() != other; }
+
+  // the name that stands for the string of the handle
+  static Name fromHandle(const FileHandle &fh);
+
+  [[nodiscard]] bool empty() const { return key == nullptr; }
+  [[nodiscard]] bool isHandle() const {
+    return reinterpret_cast<uintptr_t>(key) & 1;
+  }
+  void clear() { key = nullptr; }
+
+  // the characters are empty for a name that stands for a handle
+  [[nodiscard]] size_t size() const {
+    return key && !isHandle() ? key->size : 0;
+  }
+  [[nodiscard]] const char *c_str() const {
+    return key && !isHandle() ? key->data() : "";
+  }
+  [[nodiscard]] std::string_view view() const {
+    return key && !isHandle() ? key->key() : std::string_view();
+  }
+  [[nodiscard]] std::string str() const;
+
+  [[nodiscard]] size_t hash() const { return key ? untagged()->hash : 0; }
+
+  // number of distinct names seen so far
+  static uint64_t count();
+  // bytes taken by the names seen so far
+  static uint64_t memory();
+};
+
+}  // namespace parser
+
+namespace std {
+template <>
+struct hash<parser::Name> {
+  std::size_t operator()(parser::Name const &n) const { return n.hash(); }
+};
+}  // namespace std
+
+#endif /* PARSER_NAME_H_ */
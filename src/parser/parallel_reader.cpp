@@ -0,0 +1,226 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "parser/parallel_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "parser/parser.hpp"
+
+namespace parser {
+
+ParallelFrameReader::ParallelFrameReader(
+    std::unique_ptr<input::LineReader> input, unsigned threads,
+    bool allOperations)
+    : input(std::move(input)),
+      threadCount(std::max(1u, threads)),
+      allOperations(allOperations),
+      batches(4 * threadCount) {}
+
+ParallelFrameReader::~ParallelFrameReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  readerCond.notify_all();
+  workerCond.notify_all();
+
+  for (auto &t : threads) t.join();
+}
+
+void ParallelFrameReader::start() {
+  threads.emplace_back(&ParallelFrameReader::readInput, this);
+
+  for (unsigned i = 0; i < threadCount; ++i)
+    threads.emplace_back(&ParallelFrameReader::parseBatches, this);
+}
+
+void ParallelFrameReader::seekTo(const input::Checkpoint &cp) {
+  if (!threads.empty())
+    throw ParallelReaderException(
+        "ParallelFrameReader: Seeking is only possible before reading");
+
+  input->seek(cp);
+  batchStart = cp.lines;
+}
+
+void ParallelFrameReader::readInput() {
+  std::string_view chunk;
+  input::Checkpoint cp;
+  bool more = true;
+
+  try {
+    while (more) {
+      Batch *batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        readerCond.wait(lock, [this] {
+          return stop || filled < current + batches.size();
+        });
+        if (stop) return;
+
+        batch = &batches[filled % batches.size()];
+      }
+
+      // the slot is owned by this thread until filled is increased
+      if ((more = input->readChunk(chunk, PARSE_BATCH_SIZE))) {
+        if (hasIndex() && input->takeCheckpoint(cp))
+          batch->checkpoints.emplace_back(0, std::move(cp));
+
+        if (input->stableChunks()) {
+          batch->text = chunk;
+        } else {
+          batch->storage.assign(chunk);
+          batch->text = batch->storage;
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (more)
+        filled++;
+      else
+        eof = true;
+      workerCond.notify_all();
+    }
+  } catch (std::exception &e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = e.what();
+    eof = true;
+    workerCond.notify_all();
+  }
+
+  consumerCond.notify_one();
+}
+
+void ParallelFrameReader::parseBatches() {
+  Parser parser(allOperations);
+
+  while (true) {
+    Batch *batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      workerCond.wait(lock, [this] { return stop || next < filled || eof; });
+      if (stop || next >= filled) return;
+
+      batch = &batches[next++ % batches.size()];
+    }
+
+    const char *pos = batch->text.data();
+    const char *end = pos + batch->text.size();
+    uint32_t i = 0;
+
+    try {
+      for (; pos < end; ++i) {
+        // the last line of the input may lack the newline
+        auto nl = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        if (!nl) nl = end;
+        std::string_view line(pos, nl - pos);
+        pos = nl + 1;
+
+        if (line.empty()) continue;
+
+        auto frame = parser.parse(line);
+        if (frame) {
+          // decoding interns the handles and names, which takes a while
+          if (parser.keepsAttributes(frame->operation)) frame->decode();
+          batch->frames.push_back(std::move(frame));
+          batch->frameLines.push_back(i);
+        }
+      }
+    } catch (std::exception &e) {
+      batch->error = e.what();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    batch->lineCount = i;
+    batch->parsed = true;
+    consumerCond.notify_one();
+  }
+}
+
+FramePtr ParallelFrameReader::read() {
+  if (threads.empty()) start();
+
+  while (true) {
+    if (!active) {
+      std::unique_lock<std::mutex> lock(mutex);
+      consumerCond.wait(lock, [this] {
+        return current < filled ? batches[current % batches.size()].parsed
+                                : eof;
+      });
+
+      if (current == filled) {
+        if (!error.empty()) throw ParallelReaderException(error);
+        return FramePtr(nullptr);
+      }
+
+      active = &batches[current % batches.size()];
+    }
+
+    if (!active->error.empty()) throw ParallelReaderException(active->error);
+
+    if (framePos < active->frames.size()) {
+      uint32_t line = active->frameLines[framePos];
+
+      addCheckpoints(line);
+      lines = batchStart + line + 1;
+
+      auto frame = std::move(active->frames[framePos++]);
+      frameRead(*frame);
+      return frame;
+    }
+
+    addCheckpoints(active->lineCount);
+    batchStart += active->lineCount;
+    lines = batchStart;
+
+    // keep the capacity of the buffers for the next batch in this slot
+    active->text = std::string_view();
+    active->storage.clear();
+    active->lineCount = 0;
+    active->checkpoints.clear();
+    active->frames.clear();
+    active->frameLines.clear();
+    active->parsed = false;
+    active = nullptr;
+    framePos = checkpointPos = 0;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      current++;
+    }
+    readerCond.notify_one();
+  }
+}
+
+void ParallelFrameReader::addCheckpoints(uint32_t line) {
+  auto &checkpoints = active->checkpoints;
+
+  while (checkpointPos < checkpoints.size() &&
+         checkpoints[checkpointPos].first <= line) {
+    lines = batchStart + checkpoints[checkpointPos].first;
+    addCheckpoint(std::move(checkpoints[checkpointPos].second));
+    checkpointPos++;
+  }
+}
+
+}  // namespace parser
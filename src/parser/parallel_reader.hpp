@@ -0,0 +1,127 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_PARALLEL_READER_H_
+#define PARSER_PARALLEL_READER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "input/line_reader.hpp"
+#include "input/time_index.hpp"
+#include "parser/frame.hpp"
+#include "parser/frame_pool.hpp"
+#include "parser/frame_reader.hpp"
+
+namespace parser {
+
+/*
+ * amount of trace text collected into a single batch
+ */
+#define PARSE_BATCH_SIZE (1024 * 1024)
+
+/*
+ * Parses the text format on several threads. A reader thread cuts the
+ * input into chunks of complete lines, which are only copied if the
+ * input is not mapped. The workers parse the chunks into frames and
+ * decode the attributes the replay needs, and read() hands the frames
+ * out strictly in input order. The number of batches in flight is
+ * bounded, so the memory usage does not depend on how far the replay
+ * lags behind.
+ */
+class ParallelFrameReader : public FrameReader {
+ private:
+  struct Batch {
+    // complete lines, in the mapped input or in storage
+    std::string_view text;
+    std::string storage;
+    uint32_t lineCount = 0;
+    // checkpoints taken before the line with the given index
+    std::vector<std::pair<uint32_t, input::Checkpoint>> checkpoints;
+    std::vector<FramePtr> frames;
+    // index of the line every frame was parsed from
+    std::vector<uint32_t> frameLines;
+    std::string error;
+    bool parsed = false;
+  };
+
+  std::unique_ptr<input::LineReader> input;
+  unsigned threadCount;
+  bool allOperations;
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable readerCond;
+  std::condition_variable workerCond;
+  std::condition_variable consumerCond;
+  // ring of batches in flight indexed by sequence number
+  std::vector<Batch> batches;
+  // sequence number of the batch handed out by read()
+  uint64_t current = 0;
+  // sequence number of the next batch the reader fills
+  uint64_t filled = 0;
+  // sequence number of the next batch a worker parses
+  uint64_t next = 0;
+  bool eof = false;
+  bool stop = false;
+  std::string error;
+
+  // the batch handed out by read() and the read position in it
+  Batch *active = nullptr;
+  size_t framePos = 0;
+  size_t checkpointPos = 0;
+  // number of trace lines before the active batch
+  unsigned long long batchStart = 0;
+
+  void start();
+  void readInput();
+  void parseBatches();
+  // adds the checkpoints of the active batch up to the given line
+  void addCheckpoints(uint32_t line);
+
+ protected:
+  void seekTo(const input::Checkpoint &cp) override;
+
+ public:
+  ParallelFrameReader(std::unique_ptr<input::LineReader> input,
+                      unsigned threads, bool allOperations = false);
+  ~ParallelFrameReader() override;
+
+  ParallelFrameReader(const ParallelFrameReader &) = delete;
+  ParallelFrameReader &operator=(const ParallelFrameReader &) = delete;
+
+  FramePtr read() override;
+
+  [[nodiscard]] bool seekable() const override { return input->seekable(); }
+
+  class ParallelReaderException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+};
+
+}  // namespace parser
+
+#endif /* PARSER_PARALLEL_READER_H_ */
@@ -18,43 +18,32 @@
 
 #include "parser/parser.hpp"
 
-#include <cstring>
-#include <map>
+#include <cctype>
 #include <memory>
 #include <string>
+#include <string_view>
 
-namespace parser {
+#include "parser/convert.hpp"
 
-std::unique_ptr<Frame> Parser::parse(char *line) {
-  char *pos = line;
-  char *token = line;
-  char *src = nullptr;
-  char *dest = nullptr;
-  char *last_token = nullptr;
-  int count = 0;
-  bool eol = false;
+namespace parser {
 
-  if (!isdigit(*pos)) return std::unique_ptr<Frame>(nullptr);
+FramePtr Parser::parse(std::string_view line) {
+  std::string_view src;
+  std::string_view dest;
 
-  auto frame = std::make_unique<Frame>();
+  if (line.empty() || !isdigit(line[0]))
+    return FramePtr(nullptr);
 
-  while (!eol) {
-    if (*pos == '"') {
-      // if it starts with " ignore space until end "
-      pos++;
-      token++;
-      while (*pos != 0 && *pos != '"') pos++;
-    } else {
-      while (*pos != 0 && *pos != ' ') pos++;
-    }
+  auto frame = allocFrame();
+  // the attributes are left to Frame::decode()
+  auto &tokens = tokenizer.tokenize(line, 9);
 
-    if (*pos == 0) eol = true;
-
-    *pos = 0;
+  for (size_t count = 0; count < tokens.size(); ++count) {
+    std::string_view token = tokens[count];
 
     switch (count) {
       case 0:
-        frame->time = strtoull(token, nullptr, 10);
+        frame->time = parseDec(token);
         break;
       case 1:
         src = token;
@@ -64,15 +53,15 @@ std::unique_ptr<Frame> Parser::parse(char *line) {
         break;
       case 4:
         // protocol
-        if (*token == 'R') {
-          if (token[1] == '2')
+        if (!token.empty() && token[0] == 'R') {
+          if (token.size() > 1 && token[1] == '2')
             frame->protocol = R2;
           else
             frame->protocol = R3;
 
           frame->client = parseClientId(dest);
-        } else if (*token == 'C') {
-          if (token[1] == '2')
+        } else if (!token.empty() && token[0] == 'C') {
+          if (token.size() > 1 && token[1] == '2')
             frame->protocol = C2;
           else
             frame->protocol = C3;
@@ -81,7 +70,7 @@ std::unique_ptr<Frame> Parser::parse(char *line) {
         }
         break;
       case 5:
-        frame->xid = strtoul(token, nullptr, 16);
+        frame->xid = parseHex(token);
         break;
       /*case 6:
                // cannot use opcode cause it is different for R2 R3
@@ -92,27 +81,31 @@ std::unique_ptr<Frame> Parser::parse(char *line) {
         break;
       case 8:
         if (frame->protocol == R2 || frame->protocol == R3) {
-          if (!strcmp(token, "OK"))
+          if (token == "OK")
             frame->status = FOK;
           else
             frame->status = FERROR;
         }
         break;
     }
-
-    if (last_token && (count > 8 || (count == 8 && (frame->protocol == R2 ||
-                                                    frame->protocol == R3)))) {
-      frame->setAttribute(last_token, token);
-    }
-
-    pos++;
-    last_token = token;
-    token = pos;
-    count++;
   }
 
   if (frame->protocol == NOPROT) {
-    return std::unique_ptr<Frame>(nullptr);
+    return FramePtr(nullptr);
+  }
+
+  /*
+   * Every attribute token is the key of the next one. For responses
+   * this starts with the operation and the status, for requests with
+   * the first attribute key. Token k starts after the separator that
+   * follows token k - 1. The attributes of the operations the replay
+   * drops are not even copied.
+   */
+  size_t first = frame->protocol == R2 || frame->protocol == R3 ? 7 : 8;
+  if (tokens.size() > first && keepsAttributes(frame->operation)) {
+    std::string_view prev = tokens[first - 1];
+    frame->raw.assign(prev.data() + prev.size() + 1,
+                      line.data() + line.size());
   }
 
   return frame;
@@ -19,71 +19,73 @@
 #ifndef PARSER_H_
 #define PARSER_H_
 
-#include <cstring>
-#include <map>
+#include <algorithm>
+#include <cctype>
 #include <memory>
+#include <string_view>
 
+#include "parser/convert.hpp"
 #include "parser/frame.hpp"
+#include "parser/frame_pool.hpp"
+#include "parser/perfect_hash.hpp"
+#include "parser/tokenizer.hpp"
 
 namespace parser {
 
+inline constexpr PerfectHash<OpId, 64, true>::Entry opKeys[] = {
+    {"null", NULLOP},
+    {"getattr", GETATTR},
+    {"setattr", SETATTR},
+    {"lookup", LOOKUP},
+    {"access", ACCESS},
+    {"read", READ},
+    {"readlink", READLINK},
+    {"write", WRITE},
+    {"create", CREATE},
+    {"mkdir", MKDIR},
+    {"symlink", SYMLINK},
+    {"mknod", MKNOD},
+    {"remove", REMOVE},
+    {"rmdir", RMDIR},
+    {"rename", RENAME},
+    {"link", LINK},
+    {"readdir", READDIR},
+    {"readdirp", READDIRPLUS},
+    {"readdirplus", READDIRPLUS},
+    {"fsstat", FSSTAT},
+    {"fsinfo", FSINFO},
+    {"pathconf", PATHCONF},
+    {"commit", COMMIT}};
+
+// operation names are matched case insensitively
+inline constexpr PerfectHash<OpId, 64, true> opIds(opKeys, NULLOP);
+
 class Parser {
  private:
-  struct CompareCStrings {
-    bool operator()(const char *lhs, const char *rhs) const {
-      return std::strcmp(lhs, rhs) < 0;
-    }
-  };
-
-  std::map<const char *, OpId, CompareCStrings> opmap;
+  Tokenizer tokenizer;
+  // keep the attributes of the operations the replay ignores
+  bool allOperations;
 
-  uint32_t parseClientId(const char *token) {
-    char *pEnd;
-    uint32_t first = strtoul(token, &pEnd, 16);
-    pEnd++;
-    uint32_t second = strtoul(pEnd, nullptr, 16);
+  uint32_t parseClientId(std::string_view token) {
+    size_t len;
+    uint32_t first = parseHex(token, &len);
+    // skip the separating dot
+    uint32_t second = parseHex(token.substr(std::min(len + 1, token.size())));
     return (first << 16) | second;
   }
 
-  OpId parseOpId(char *op) {
-    char *pos = op;
-    while (*pos != 0) {
-      *pos = tolower(*pos);
-      pos++;
-    }
-    auto it = opmap.find(op);
-    if (it != opmap.end()) return it->second;
-    return NULLOP;
-  }
+  OpId parseOpId(std::string_view op) { return opIds.find(op); }
 
  public:
-  Parser() {
-    opmap["null"] = NULLOP;
-    opmap["getattr"] = GETATTR;
-    opmap["setattr"] = SETATTR;
-    opmap["lookup"] = LOOKUP;
-    opmap["access"] = ACCESS;
-    opmap["read"] = READ;
-    opmap["readlink"] = READLINK;
-    opmap["write"] = WRITE;
-    opmap["create"] = CREATE;
-    opmap["mkdir"] = MKDIR;
-    opmap["symlink"] = SYMLINK;
-    opmap["mknod"] = MKNOD;
-    opmap["remove"] = REMOVE;
-    opmap["rmdir"] = RMDIR;
-    opmap["rename"] = RENAME;
-    opmap["link"] = LINK;
-    opmap["readdir"] = READDIR;
-    opmap["readdirp"] = READDIRPLUS;
-    opmap["readdirplus"] = READDIRPLUS;
-    opmap["fsstat"] = FSSTAT;
-    opmap["fsinfo"] = FSINFO;
-    opmap["pathconf"] = PATHCONF;
-    opmap["commit"] = COMMIT;
+  explicit Parser(bool allOperations = false)
+      : allOperations(allOperations) {}
+
+  // whether the attributes of frames with the operation are kept
+  [[nodiscard]] bool keepsAttributes(OpId op) const {
+    return allOperations || isReplayed(op);
   }
 
-  std::unique_ptr<Frame> parse(char *line);
+  FramePtr parse(std::string_view line);
 };
 
 }  // namespace parser
@@ -0,0 +1,104 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_PERFECT_HASH_H_
+#define PARSER_PERFECT_HASH_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace parser {
+
+/*
+ * Lookup table for a fixed set of keys, which is built at compile time.
+ * The constructor searches a seed for which the FNV-1a hashes of all keys
+ * land in different slots, so a lookup is one hash and one comparison.
+ *
+ * With FoldCase the lookup ignores the case of ASCII letters. The keys
+ * have to be lower case letters then, because the folding simply sets
+ * bit 5 of every character.
+ */
+template <typename Value, size_t Size, bool FoldCase = false>
+class PerfectHash {
+ public:
+  struct Entry {
+    std::string_view key;
+    Value value;
+  };
+
+ private:
+  std::array<Entry, Size> table{};
+  uint32_t seed = 0;
+  Value missing;
+
+  static constexpr uint8_t fold(char c) {
+    return FoldCase ? static_cast<uint8_t>(c) | 0x20 : static_cast<uint8_t>(c);
+  }
+
+  static constexpr size_t hash(std::string_view key, uint32_t seed) {
+    uint32_t h = seed;
+
+    for (char c : key) h = (h ^ fold(c)) * 16777619u;
+
+    return (h ^ (h >> 16)) % Size;
+  }
+
+ public:
+  template <size_t N>
+  constexpr PerfectHash(const Entry (&entries)[N], Value missing)
+      : missing(missing) {
+    static_assert(N <= Size, "PerfectHash: Table too small");
+
+    for (seed = 2166136261u;; ++seed) {
+      bool used[Size] = {};
+      bool collision = false;
+
+      for (const Entry &e : entries) {
+        size_t h = hash(e.key, seed);
+        if (used[h]) {
+          collision = true;
+          break;
+        }
+        used[h] = true;
+      }
+
+      if (!collision) break;
+    }
+
+    for (Entry &e : table) e = Entry{std::string_view(), missing};
+    for (const Entry &e : entries) table[hash(e.key, seed)] = e;
+  }
+
+  // returns the value of key or the missing value
+  constexpr Value find(std::string_view key) const {
+    const Entry &e = table[hash(key, seed)];
+
+    if (e.key.size() != key.size()) return missing;
+
+    for (size_t i = 0; i < key.size(); ++i)
+      if (fold(key[i]) != static_cast<uint8_t>(e.key[i])) return missing;
+
+    return e.value;
+  }
+};
+
+}  // namespace parser
+
+#endif /* PARSER_PERFECT_HASH_H_ */
@@ -0,0 +1,235 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_TOKENIZER_H_
+#define PARSER_TOKENIZER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TOKENIZER_X86
+#include <immintrin.h>
+#endif
+
+namespace parser {
+
+/*
+ * The classifiers set bit i of spaces and quotes, if byte i of the data
+ * is a space or a quote. Each word of the masks covers 64 bytes.
+ */
+using Classifier = void (*)(const char *data, size_t len, uint64_t *spaces,
+                            uint64_t *quotes);
+
+inline void classifyScalar(const char *data, size_t len, uint64_t *spaces,
+                           uint64_t *quotes) {
+  for (size_t i = 0; i < len; i += 64) {
+    size_t n = len - i < 64 ? len - i : 64;
+    uint64_t s = 0;
+    uint64_t q = 0;
+
+    for (size_t j = 0; j < n; ++j) {
+      s |= static_cast<uint64_t>(data[i + j] == ' ') << j;
+      q |= static_cast<uint64_t>(data[i + j] == '"') << j;
+    }
+
+    spaces[i / 64] = s;
+    quotes[i / 64] = q;
+  }
+}
+
+#ifdef TOKENIZER_X86
+
+__attribute__((target("sse2"))) inline void classifySse2(const char *data,
+                                                         size_t len,
+                                                         uint64_t *spaces,
+                                                         uint64_t *quotes) {
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i qu = _mm_set1_epi8('"');
+  char tail[64];
+
+  for (size_t i = 0; i < len; i += 64) {
+    const char *p = data + i;
+    uint64_t s = 0;
+    uint64_t q = 0;
+
+    // never read past the end of the line, it may end a mapping
+    if (len - i < 64) {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, p, len - i);
+      p = tail;
+    }
+
+    for (int j = 0; j < 4; ++j) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p) + j);
+      s |= static_cast<uint64_t>(static_cast<uint16_t>(
+               _mm_movemask_epi8(_mm_cmpeq_epi8(v, sp))))
+           << (16 * j);
+      q |= static_cast<uint64_t>(static_cast<uint16_t>(
+               _mm_movemask_epi8(_mm_cmpeq_epi8(v, qu))))
+           << (16 * j);
+    }
+
+    spaces[i / 64] = s;
+    quotes[i / 64] = q;
+  }
+}
+
+__attribute__((target("avx2"))) inline void classifyAvx2(const char *data,
+                                                         size_t len,
+                                                         uint64_t *spaces,
+                                                         uint64_t *quotes) {
+  const __m256i sp = _mm256_set1_epi8(' ');
+  const __m256i qu = _mm256_set1_epi8('"');
+  char tail[64];
+
+  for (size_t i = 0; i < len; i += 64) {
+    const char *p = data + i;
+
+    if (len - i < 64) {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, p, len - i);
+      p = tail;
+    }
+
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p) + 1);
+
+    uint32_t sLo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, sp));
+    uint32_t sHi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, sp));
+    uint32_t qLo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, qu));
+    uint32_t qHi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, qu));
+
+    spaces[i / 64] = sLo | static_cast<uint64_t>(sHi) << 32;
+    quotes[i / 64] = qLo | static_cast<uint64_t>(qHi) << 32;
+  }
+}
+
+#endif /* TOKENIZER_X86 */
+
+// the fastest classifier supported by the CPU
+inline Classifier defaultClassifier() {
+#ifdef TOKENIZER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return classifyAvx2;
+  return classifySse2;
+#else
+  return classifyScalar;
+#endif
+}
+
+/*
+ * Splits a trace line into its fields. The bytes of the line are
+ * classified in one vectorized pass and the fields are then found by
+ * scanning the bit masks instead of the characters.
+ *
+ * Fields are separated by single spaces. A field starting with a quote
+ * extends to the next quote and may contain spaces. The character after
+ * the closing quote starts the next field, so a quoted field followed by
+ * a space is followed by an empty field. This is the field numbering of
+ * the traces the parser has always used.
+ */
+class Tokenizer {
+ private:
+  Classifier classify;
+  std::vector<uint64_t> spaces;
+  std::vector<uint64_t> quotes;
+  std::vector<std::string_view> tokens;
+
+  // position of the first set bit at or after pos or len
+  static size_t next(const uint64_t *mask, size_t words, size_t pos,
+                     size_t len) {
+    size_t word = pos / 64;
+
+    if (word >= words) return len;
+
+    // the classifiers never set bits past the end of the line
+    uint64_t bits = mask[word] & (~0ULL << (pos % 64));
+    while (!bits) {
+      if (++word == words) return len;
+      bits = mask[word];
+    }
+
+    return word * 64 + __builtin_ctzll(bits);
+  }
+
+ public:
+  explicit Tokenizer(Classifier classify = defaultClassifier())
+      : classify(classify) {}
+
+  /*
+   * Returns at most maxTokens tokens, which are the same as the first
+   * tokens of the whole line. They stay valid until the next call.
+   */
+  const std::vector<std::string_view> &tokenize(
+      std::string_view line, size_t maxTokens = SIZE_MAX) {
+    const char *data = line.data();
+    size_t len = line.size();
+    size_t words = (len + 63) / 64;
+    size_t pos = 0;
+    size_t start = 0;
+    bool eol = false;
+
+    if (spaces.size() < words) {
+      spaces.resize(words);
+      quotes.resize(words);
+    }
+    classify(data, len, spaces.data(), quotes.data());
+
+    // the space bits at or after pos are consumed one by one
+    size_t word = 0;
+    uint64_t bits = words ? spaces[0] : 0;
+
+    tokens.clear();
+    while (!eol && tokens.size() < maxTokens) {
+      if (pos < len && data[pos] == '"') {
+        pos++;
+        start++;
+        pos = next(quotes.data(), words, pos, len);
+
+        // continue with the spaces after the closing quote
+        word = (pos + 1) / 64;
+        bits = word < words ? spaces[word] & (~0ULL << ((pos + 1) % 64)) : 0;
+      } else {
+        while (!bits && ++word < words) bits = spaces[word];
+
+        if (bits) {
+          pos = word * 64 + __builtin_ctzll(bits);
+          bits &= bits - 1;
+        } else {
+          pos = len;
+        }
+      }
+
+      if (pos == len) eol = true;
+
+      tokens.emplace_back(data + start, pos - start);
+
+      pos++;
+      start = pos;
+    }
+
+    return tokens;
+  }
+};
+
+}  // namespace parser
+
+#endif /* PARSER_TOKENIZER_H_ */
@@ -21,13 +21,12 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
-#include <utime.h>
 
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
-#include <set>
 #include <string>
 
 #include "parser/file_handle.hpp"
@@ -39,19 +38,46 @@ using namespace parser;
 
 namespace replay {
 
-void Engine::createMoveElement(tree::Node *element, tree::Node *parent,
-                               const string &name) {
-  if (element->isCreated()) {
-    string oldpath = element->calcPath();
-    string newpath = parent->makePath() + '/' + name;
+void Engine::settle(tree::Node *element) {
+  writes.flush(element);
 
-    // Move element to new parent
-    if (rename(oldpath.c_str(), newpath.c_str())) {
-      logger.error("ERROR moving");
-    } else {
-      if (oldpath != newpath) remove(oldpath.c_str());
-    }
+  if (ring) {
+    // the paths below a directory change with it
+    if (element->isDir())
+      ring->drain();
+    else
+      ring->wait(element);
   }
+}
+
+void Engine::settleAll() {
+  writes.flushAll();
+  if (ring) ring->drain();
+}
+
+// renames the file of element to name in dir like rename(2)
+static int renameEntry(tree::Node *element, tree::Node *dir,
+                       const Name &name) {
+  dir->makePath();
+
+  if (renameat(element->parentFd(), element->getName().str().c_str(),
+               dir->dirFd(), name.str().c_str()))
+    return -1;
+
+  // rename(2) does nothing if both names are links of the same file
+  if (element->getParent() != dir || element->getName() != name)
+    element->removeEntry();
+
+  return 0;
+}
+
+void Engine::createMoveElement(tree::Node *element, tree::Node *parent,
+                               const Name &name) {
+  settle(element);
+
+  // Move element to new parent
+  if (element->isCreated() && renameEntry(element, parent, name))
+    logger.error("ERROR moving");
 
   // Move element to new parent
   tree::Node *oldparent = element->getParent();
@@ -62,9 +88,11 @@ void Engine::createMoveElement(tree::Node *element, tree::Node *parent,
 }
 
 void Engine::createChangeFType(tree::Node *element, FType ftype) {
+  settle(element);
+
   if (ftype == DIR && !element->isDir()) {
     if (element->isCreated()) {
-      if (remove(element->calcPath().c_str())) {
+      if (element->removeEntry()) {
         logger.error("ERROR changing type");
       } else {
         element->setCreated(false);
@@ -74,7 +102,7 @@ void Engine::createChangeFType(tree::Node *element, FType ftype) {
     element->setDir(true);
   } else if (ftype != DIR && element->isDir()) {
     if (element->isCreated()) {
-      if (remove(element->calcPath().c_str())) {
+      if (element->removeEntry()) {
         logger.error("ERROR changing type");
       } else {
         element->setCreated(false);
@@ -101,7 +129,8 @@ void Engine::createLookup(const Frame &req, const Frame &res) {
       if (res.ftype == DIR && tmp) {
         // No duplicate ids allowed
         // Rename to handle name
-        createMoveElement(element, parent, element->getHandle());
+        createMoveElement(element, parent,
+                          Name::fromHandle(element->getHandle()));
         // Move in correct element
         element = tmp;
         createMoveElement(element, parent, req.name);
@@ -138,16 +167,9 @@ void Engine::createLookup(const Frame &req, const Frame &res) {
           parent->addChild(el);
         } else {
           // File has no parent move it to new position
-          if (element->isCreated()) {
-            string oldpath = element->calcPath();
-            string newpath = parent->makePath() + '/' + req.name;
-
-            if (rename(oldpath.c_str(), newpath.c_str())) {
-              logger.error("ERROR moving");
-            } else {
-              if (oldpath != newpath) remove(oldpath.c_str());
-            }
-          }
+          settle(element);
+          if (element->isCreated() && renameEntry(element, parent, req.name))
+            logger.error("ERROR moving");
 
           element->setName(req.name);
           parent->addChild(element);
@@ -178,12 +200,15 @@ void Engine::createFile(const Frame &req, const Frame &res) {
 
   tree::Node *element = parent->getChild(req.name);
   if (element) {
+    settle(element);
+
     if (element->getHandle() != res.fh) {
       auto tmp = fhmap.getNode(res.fh);
       if (res.ftype == DIR && tmp) {
         // No duplicate ids allowed
         // Rename to handle name
-        createMoveElement(element, parent, element->getHandle());
+        createMoveElement(element, parent,
+                          Name::fromHandle(element->getHandle()));
         // Move in correct element
         element = tmp;
         createMoveElement(element, parent, req.name);
@@ -218,8 +243,10 @@ void Engine::createFile(const Frame &req, const Frame &res) {
     } else {
       element = fhmap.getNode(res.fh);
       if (element) {
+        settle(element);
+
         if (element->isCreated()) {
-          if (remove(element->calcPath().c_str()))
+          if (element->removeEntry())
             logger.error("ERROR creating element");
           else
             element->setCreated(false);
@@ -257,11 +284,10 @@ void Engine::removeFile(const Frame &req, const Frame &res) {
 
   tree::Node *element = dir->getChild(req.name);
   if (element && element->isDeletable()) {
-    if (element->isCreated()) {
-      string path = element->calcPath();
+    settle(element);
 
-      if (remove(path.c_str())) logger.error("ERROR removing");
-    }
+    if (element->isCreated() && element->removeEntry())
+      logger.error("ERROR removing");
 
     dir->deleteChild(element);
     dir->clearEmptyDir();
@@ -279,8 +305,6 @@ void Engine::writeFile(const Frame &req, const Frame &res) {
   if (element->getParent() && !element->getParent()->isCreated())
     element->getParent()->makePath();
 
-  string path = element->calcPath();
-
   int mode = O_RDWR | O_CREAT;
   if (element->getSize() == 0) mode |= O_TRUNC;
 
@@ -288,13 +312,10 @@ void Engine::writeFile(const Frame &req, const Frame &res) {
     element->setSize(req.offset + req.count);
 
   int i, fd = -1;
-  ssize_t ret = 0;
 
   // try three times to open the file and then give up
   for (i = 0; i < 3; ++i) {
-    if ((fd = open(path.c_str(), mode, S_IRUSR | S_IWUSR)) != -1 ||
-        errno != ENOSPC)
-      break;
+    if ((fd = element->openFile(mode)) != -1 || errno != ENOSPC) break;
     sleep(10);
   }
 
@@ -303,35 +324,64 @@ void Engine::writeFile(const Frame &req, const Frame &res) {
   } else if (sett.inodeTest) {
     element->setCreated(true);
     ftruncate(fd, element->getSize());
-    close(fd);
   } else {
     element->setCreated(true);
-    if (lseek(fd, req.offset, SEEK_SET) == -1) {
-      logger.error("ERROR seeking file");
-    } else {
-      uint32_t count = req.count;
-      while (count > 0) {
-        auto s = min((uint32_t)RANDBUF_SIZE, count);
-
-        // try three times to write the file and then give up
-        for (i = 0; i < 3; ++i) {
-          if ((ret = write(fd, randbuf, s)) > -1 || errno != ENOSPC) break;
-          sleep(10);
-        }
-        if (ret == -1) {
-          logger.error("ERROR writing file");
-          break;
-        }
-        count -= ret;
-      }
+
+    if (sett.coalesceWrites)
+      writes.add(element, req.offset, req.count, res.time);
+    else if (ring)
+      ring->write(element, req.offset, req.count, sett.dataSync);
+    else
+      writeData(fd, req.offset, req.count);
+  }
+}
+
+void Engine::writeData(int fd, uint64_t offset, uint64_t count) {
+  struct iovec iov[WRITE_MAX_IOV];
+  ssize_t ret = 0;
+
+  // the descriptor is cached, so every write says where it goes
+  while (count > 0) {
+    int n = 0;
+    uint64_t len = 0;
+    for (; n < WRITE_MAX_IOV && len < count; ++n) {
+      iov[n].iov_base = randbuf;
+      iov[n].iov_len = min((uint64_t)RANDBUF_SIZE, count - len);
+      len += iov[n].iov_len;
     }
-    if (sett.dataSync) {
-      fdatasync(fd);
+
+    // try three times to write the file and then give up
+    for (int i = 0; i < 3; ++i) {
+      if ((ret = pwritev(fd, iov, n, offset)) > -1 || errno != ENOSPC) break;
+      sleep(10);
+    }
+    if (ret == -1) {
+      logger.error("ERROR writing file");
+      break;
     }
-    close(fd);
+    offset += ret;
+    count -= ret;
+  }
+  if (sett.dataSync) {
+    fdatasync(fd);
   }
 }
 
+void Engine::writeRun(const WriteCoalescer::Run &run) {
+  if (ring) {
+    ring->write(run.node, run.start, run.end - run.start, sett.dataSync);
+    return;
+  }
+
+  // every change to the file flushes its run before
+  int fd = run.node->openFile(0);
+
+  if (fd == -1)
+    logger.error("ERROR opening file");
+  else
+    writeData(fd, run.start, run.end - run.start);
+}
+
 void Engine::renameFile(const Frame &req, const Frame &res) {
   if (req.fh.empty() || req.fh2.empty() || req.name.empty() ||
       req.name2.empty() || (req.fh == req.fh2 && req.name == req.name2))
@@ -351,16 +401,11 @@ void Engine::renameFile(const Frame &req, const Frame &res) {
 
   tree::Node *el2 = dir2->getChild(req.name2);
   if ((!el2 || el2->isDeletable()) && el != el2) {
-    if (el->isCreated()) {
-      string oldpath = el->calcPath();
-      string newpath = dir2->makePath() + '/' + req.name2;
+    settle(el);
+    if (el2) settle(el2);
 
-      if (rename(oldpath.c_str(), newpath.c_str())) {
-        logger.error("ERROR renaming");
-      } else {
-        if (oldpath != newpath) remove(oldpath.c_str());
-      }
-    }
+    if (el->isCreated() && renameEntry(el, dir2, req.name2))
+      logger.error("ERROR renaming");
 
     // target already exists and must be deleted cause it gets overwritten
     if (el2) {
@@ -394,29 +439,24 @@ void Engine::createLink(const Frame &req, const Frame &res) {
   tree::Node *element = targetdir->getChild(req.name);
   if ((!element || element->isDeletable()) && element != srcfile) {
     if (element) {
-      if (element->isCreated()) {
-        string path = element->calcPath();
-        if (remove(path.c_str())) {
-          logger.error("ERROR removing");
-          return;
-        }
+      settle(element);
+      if (element->isCreated() && element->removeEntry()) {
+        logger.error("ERROR removing");
+        return;
       }
       targetdir->deleteChild(element);
       fhmap.removeNode(element);
     }
-    string oldpath;
-    string newpath;
-    if (srcfile->isCreated()) {
-      oldpath = srcfile->calcPath();
-      newpath = targetdir->makePath() + '/' + req.name;
-    }
+    if (srcfile->isCreated()) targetdir->makePath();
 
     // Linked file has the same handle but different names
     auto el = fhmap.createNode(srcfile->getHandle(), req.name, res.time);
     targetdir->addChild(el);
 
     if (srcfile->isCreated()) {
-      if (link(oldpath.c_str(), newpath.c_str()) && errno != EEXIST)
+      if (linkat(srcfile->parentFd(), srcfile->getName().str().c_str(),
+                 targetdir->dirFd(), req.name.c_str(), 0) &&
+          errno != EEXIST)
         logger.error("ERROR creating link");
       else
         el->setCreated(true);
@@ -435,12 +475,10 @@ void Engine::createSymlink(const Frame &req, const Frame &res) {
   if (element && !element->isDeletable()) return;
 
   if (element) {
-    if (element->isCreated()) {
-      string path = element->calcPath();
-      if (remove(path.c_str())) {
-        logger.error("ERROR removing");
-        return;
-      }
+    settle(element);
+    if (element->isCreated() && element->removeEntry()) {
+      logger.error("ERROR removing");
+      return;
     }
     dir->deleteChild(element);
     fhmap.removeNode(element);
@@ -450,9 +488,10 @@ void Engine::createSymlink(const Frame &req, const Frame &res) {
   dir->addChild(el);
 
   if (dir->isCreated()) {
-    string path = dir->makePath() + '/' + req.name;
+    dir->makePath();
 
-    if (symlink(req.name2.c_str(), path.c_str()) && errno != EEXIST)
+    if (symlinkat(req.name2.c_str(), dir->dirFd(), req.name.c_str()) &&
+        errno != EEXIST)
       logger.error("ERROR creating symlink");
     else
       el->setCreated(true);
@@ -467,11 +506,15 @@ void Engine::getAttr(const Frame &req, const Frame &res) {
 
   element->setLastAccess(res.time);
 
-  if (element->isCreated()) {
-    string path = element->calcPath();
+  if (element->isCreated() && ring && !element->isDir()) {
+    // a directory may be removed, once its last file is gone
+    ring->statx(element);
+  } else if (element->isCreated()) {
     struct stat buf;
 
-    if (lstat(path.c_str(), &buf)) logger.error("ERROR getting attributes");
+    if (fstatat(element->parentFd(), element->getName().str().c_str(), &buf,
+                AT_SYMLINK_NOFOLLOW))
+      logger.error("ERROR getting attributes");
   }
 }
 
@@ -482,11 +525,16 @@ void Engine::setAttr(const Frame &req, const Frame &res) {
   if (!element) return;
 
   element->setLastAccess(res.time);
+  // the pending data would change the times again
+  settle(element);
 
   if (element->isCreated()) {
-    string path = element->calcPath();
+    int dir = element->parentFd();
+    const std::string entry = element->getName().str();
+    const char *name = entry.c_str();
 
-    if (req.mode && chmod(path.c_str(), S_IXUSR | S_IRUSR | S_IWUSR | req.mode))
+    if (req.mode &&
+        fchmodat(dir, name, S_IXUSR | S_IRUSR | S_IWUSR | req.mode, 0))
       logger.error("ERROR setting attributes");
 
     /* too many wrong values in the traces e.g. > 20 TB */
@@ -495,52 +543,30 @@ void Engine::setAttr(const Frame &req, const Frame &res) {
      }*/
 
     if (req.atime || req.mtime) {
-      struct utimbuf buf;
-      buf.actime = req.atime;
-      buf.modtime = req.mtime;
+      struct timespec times[2] = {{req.atime, 0}, {req.mtime, 0}};
 
-      if (utime(path.c_str(), &buf))
+      if (utimensat(dir, name, times, 0))
         logger.error("ERROR setting mtime and atime");
     }
   }
 }
 
-static bool recursive_tree_gc(tree::Node *element, set<tree::Node *> &del_list,
-                              time_t ko_time) {
-  if (!element || element->isCreated() || element->getLastAccess() >= ko_time)
-    return false;
+unsigned Engine::gc(int64_t time) {
+  int64_t ko_time = fhmap.size() > GC_NODE_HARD_THRESHOLD
+                        ? time - GC_DISCARD_HARD_THRESHOLD
+                        : time - GC_DISCARD_THRESHOLD;
+  unsigned i;
 
-  if (del_list.count(element)) return true;
+  // Delete the oldest leaves, their parents become leaves in turn
+  for (i = 0; i < GC_BATCH_SIZE; ++i) {
+    auto element = tree::Node::leastRecentlyUsed();
+    if (!element || element->getLastAccess() >= ko_time) break;
 
-  // Test children
-  for (auto it = element->children_begin(), e = element->children_end();
-       it != e; ++it) {
-    if (recursive_tree_gc(it->second, del_list, ko_time) == false) return false;
-  }
-
-  // Found an empty not created old element
-  del_list.insert(element);
-  element->clearChildren();
-  return true;
-}
-
-void Engine::gc(int64_t time) {
-  set<tree::Node *> del_list;
-  time_t ko_time = fhmap.size() > GC_NODE_HARD_THRESHOLD
-                       ? time - GC_DISCARD_HARD_THRESHOLD
-                       : time - GC_DISCARD_THRESHOLD;
-
-  // Clear up old unused file handlers
-  for (auto &it : fhmap) {
-    tree::Node *element = it.second.get();
-    if (recursive_tree_gc(element, del_list, ko_time) && element->getParent()) {
-      element->getParent()->removeChild(element);
-    }
-  }
-
-  for (auto element : del_list) {
+    if (element->getParent()) element->getParent()->removeChild(element);
     fhmap.removeNode(element);
   }
+
+  return i;
 }
 
 }  // namespace replay
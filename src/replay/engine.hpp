@@ -21,11 +21,17 @@
 
 #include <unistd.h>
 
+#include <cstdlib>
+#include <memory>
 #include <string>
 
 #include "display/logger.hpp"
 #include "parser/file_handle.hpp"
 #include "parser/frame.hpp"
+#include "parser/frame_pool.hpp"
+#include "parser/name.hpp"
+#include "replay/io_ring.hpp"
+#include "replay/write_coalescer.hpp"
 #include "settings.hpp"
 #include "stats.hpp"
 #include "tree/file_handle_map.hpp"
@@ -37,10 +43,33 @@
  */
 #define RANDBUF_SIZE (1024 * 1024)
 
+/*
+ * maximum number of chunks of the random buffer written by one call
+ */
+#define WRITE_MAX_IOV (WRITE_COALESCE_BYTES / RANDBUF_SIZE)
+
+/*
+ * The garbage collector deletes nodes which are neither created nor
+ * parents, once there are more than GC_NODE_THRESHOLD nodes. It deletes
+ * up to GC_BATCH_SIZE nodes per frame, which were not accessed for
+ * GC_DISCARD_THRESHOLD seconds or GC_DISCARD_HARD_THRESHOLD seconds if
+ * there are more than GC_NODE_HARD_THRESHOLD nodes.
+ */
 #define GC_NODE_THRESHOLD (1024 * 1024)
 #define GC_NODE_HARD_THRESHOLD (4 * GC_NODE_THRESHOLD)
 #define GC_DISCARD_HARD_THRESHOLD (60 * 5)
 #define GC_DISCARD_THRESHOLD (60 * 60 * 24)
+#define GC_BATCH_SIZE 8
+
+/*
+ * Estimated memory of a node including its entry in the directory. The
+ * memory limit also counts the handle table, which keeps the slots of
+ * spilled nodes, and the interned handles and names, which are never
+ * freed. Above the limit, subtrees that were not accessed for
+ * SPILL_MIN_AGE seconds are spilled to a file in TMPDIR.
+ */
+#define SPILL_NODE_BYTES 128
+#define SPILL_MIN_AGE (60 * 60)
 
 namespace replay {
 
@@ -51,7 +80,11 @@ class Engine {
 
   // Map file handles to tree nodes
   tree::FileHandleMap fhmap;
+  // pending writes, if they are coalesced
+  WriteCoalescer writes;
   char randbuf[RANDBUF_SIZE];
+  // asynchronous writes and lookups, if enabled
+  std::unique_ptr<IoRing> ring;
 
   using Frame = parser::Frame;
 
@@ -65,12 +98,19 @@ class Engine {
   void getAttr(const Frame &req, const Frame &res);
   void setAttr(const Frame &req, const Frame &res);
   void createMoveElement(tree::Node *element, tree::Node *parent,
-                         const std::string &name);
+                         const parser::Name &name);
   void createChangeFType(tree::Node *element, parser::FType ftype);
+  void writeData(int fd, uint64_t offset, uint64_t count);
+  void writeRun(const WriteCoalescer::Run &run);
+  // finishes the pending operations before the file of element changes
+  void settle(tree::Node *element);
+  void settleAll();
 
  public:
   Engine(Settings &sett, Logger &logger)
-      : sett(sett), logger(logger), fhmap(GC_NODE_HARD_THRESHOLD) {
+      : sett(sett),
+        logger(logger),
+        writes([this](const WriteCoalescer::Run &run) { writeRun(run); }) {
     if (!sett.writeZero) {
       FILE *fd = fopen("/dev/urandom", "r");
       if (fread(randbuf, 1, RANDBUF_SIZE, fd) != RANDBUF_SIZE) {
@@ -82,25 +122,61 @@ class Engine {
     }
 
     tree::Node::setLogger(&logger);
+
+    if (sett.ringDepth)
+      ring = std::make_unique<IoRing>(sett.ringDepth, randbuf, RANDBUF_SIZE,
+                                      logger);
+
+    if (sett.memoryLimit) {
+      const char *dir = getenv("TMPDIR");
+      fhmap.enableSpill(dir ? dir : "/tmp");
+    }
   }
 
+  ~Engine() { settleAll(); }
+
+  Engine(const Engine &) = delete;
+  Engine &operator=(const Engine &) = delete;
+
   uint64_t size() const { return fhmap.size(); }
+  uint64_t memoryUsage() const {
+    return fhmap.size() * SPILL_NODE_BYTES + fhmap.memory() +
+           parser::FileHandle::memory() + parser::Name::memory();
+  }
+  uint64_t loadedNodes() const { return fhmap.loaded(); }
+  uint64_t coalescedWrites() const { return writes.coalesced(); }
+
+  // spills a cold subtree and returns the number of its nodes
+  uint64_t spill(int64_t time) {
+    // spilling frees the nodes, so the files with pending writes stay
+    if (!writes.pending() && !(ring && ring->size()))
+      return fhmap.spillCold(time - SPILL_MIN_AGE);
+
+    return fhmap.spillCold(time - SPILL_MIN_AGE, [this](const tree::Node *n) {
+      return writes.contains(n) || (ring && ring->contains(n));
+    });
+  }
 
   int sync() {
+    settleAll();
     // sync();
     if (syncfs(sett.syncFd) == -1) return 0;
     return 1;
   }
 
-  void gc(int64_t time);
+  // deletes a batch of unused nodes and returns their number
+  unsigned gc(int64_t time);
 
-  void process(std::unique_ptr<const Frame> &&reqp,
-               std::unique_ptr<const Frame> &&resp) {
+  void process(parser::ConstFramePtr &&reqp,
+               parser::ConstFramePtr &&resp) {
     auto &req = *reqp.get();
     auto &res = *resp.get();
 
     using namespace parser;
 
+    writes.flushBefore(res.time - WRITE_COALESCE_AGE);
+    if (ring) ring->poll();
+
     switch (res.operation) {
       case LOOKUP:
         createLookup(req, res);
@@ -135,6 +211,9 @@ class Engine {
       default:
         break;
     }
+
+    // one system call for the operations queued by the frame
+    if (ring) ring->submit();
   }
 };
 
@@ -0,0 +1,332 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay/io_ring.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace replay {
+
+#ifdef IO_RING_SUPPORTED
+
+static int ringSetup(unsigned entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ringEnter(int fd, unsigned submit, unsigned complete,
+                     unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, submit, complete, flags, nullptr,
+                 0);
+}
+
+static void *ringMap(int fd, size_t size, off_t offset) {
+  void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+IoRing::IoRing(unsigned depth, const void *data, uint32_t dataSize,
+               Logger &logger)
+    : logger(logger), data(data), dataSize(dataSize), ops(depth) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  fd = ringSetup(depth, &p);
+  if (fd == -1)
+    throw IoRingException(std::string("IoRing: ") + strerror(errno));
+
+  sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  // newer kernels map both rings at once
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    sqRingSize = std::max(sqRingSize, cqRingSize);
+    sqRing = ringMap(fd, sqRingSize, IORING_OFF_SQ_RING);
+    cqRing = sqRing;
+    cqRingSize = 0;
+  } else {
+    sqRing = ringMap(fd, sqRingSize, IORING_OFF_SQ_RING);
+    cqRing = ringMap(fd, cqRingSize, IORING_OFF_CQ_RING);
+  }
+  sqes = static_cast<struct io_uring_sqe *>(
+      ringMap(fd, sqesSize, IORING_OFF_SQES));
+
+  if (!sqRing || !cqRing || !sqes) {
+    int err = errno;
+    unmap();
+    throw IoRingException(std::string("IoRing: ") + strerror(err));
+  }
+
+  auto sq = static_cast<char *>(sqRing);
+  sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+  sqMask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+  sqEntries = p.sq_entries;
+  sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+
+  auto cq = static_cast<char *>(cqRing);
+  cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+  cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+  cqMask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+  cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+  /*
+   * The completion ring has room for twice the operations in flight,
+   * i.e. for a write and its fdatasync each.
+   */
+  freeOps.reserve(depth);
+  for (uint32_t i = depth; i > 0; --i) freeOps.push_back(i - 1);
+
+  tree::Node::setBeforeFileClose([this] { submit(); });
+}
+
+IoRing::~IoRing() {
+  tree::Node::setBeforeFileClose(nullptr);
+  unmap();
+}
+
+void IoRing::unmap() {
+  if (sqes) munmap(sqes, sqesSize);
+  if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+  if (sqRing) munmap(sqRing, sqRingSize);
+  // closing the ring cancels the operations in flight
+  close(fd);
+}
+
+uint32_t IoRing::acquire(tree::Node *node) {
+  while (freeOps.empty()) reap(true);
+
+  uint32_t slot = freeOps.back();
+  freeOps.pop_back();
+
+  ops[slot].node = node;
+  ops[slot].queued = 0;
+  ops[slot].tries = 0;
+  inflight[node]++;
+
+  return slot;
+}
+
+void IoRing::release(uint32_t slot) {
+  auto it = inflight.find(ops[slot].node);
+  if (--it->second == 0) inflight.erase(it);
+
+  freeOps.push_back(slot);
+}
+
+void IoRing::reserve(unsigned count) {
+  if (pending + count > sqEntries) enter(false);
+}
+
+struct io_uring_sqe *IoRing::prepare(uint32_t slot, uint8_t opcode) {
+  unsigned index = (*sqTail + pending) & sqMask;
+  struct io_uring_sqe *sqe = &sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->user_data = slot | static_cast<uint64_t>(opcode) << 32;
+  sqArray[index] = index;
+  ops[slot].queued++;
+  pending++;
+
+  return sqe;
+}
+
+void IoRing::enter(bool wait) {
+  // the kernel reads the entries only after the new tail
+  __atomic_store_n(sqTail, *sqTail + pending, __ATOMIC_RELEASE);
+
+  while (true) {
+    int ret = ringEnter(fd, pending, wait ? 1 : 0,
+                        wait ? IORING_ENTER_GETEVENTS : 0);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret == -1 || (ret == 0 && pending))
+      throw IoRingException(std::string("IoRing: Unable to submit: ") +
+                            strerror(ret == -1 ? errno : EAGAIN));
+
+    pending -= ret;
+    if (!pending) return;
+  }
+}
+
+void IoRing::submitWrite(uint32_t slot) {
+  Op &op = ops[slot];
+
+  // the cached descriptor may have been closed since the last chunk
+  int file = op.node->openFile(0);
+  if (file == -1) {
+    logger.error("ERROR opening file");
+    return;
+  }
+
+  // a link must not be split between two submissions
+  reserve(op.sync ? 2 : 1);
+
+  auto sqe = prepare(slot, IORING_OP_WRITE);
+  sqe->fd = file;
+  sqe->addr = reinterpret_cast<uint64_t>(data);
+  sqe->len = op.len;
+  sqe->off = op.offset;
+
+  if (op.sync) {
+    // a failed or short write cancels the fdatasync
+    sqe->flags |= IOSQE_IO_LINK;
+
+    sqe = prepare(slot, IORING_OP_FSYNC);
+    sqe->fd = file;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+  }
+}
+
+void IoRing::complete(uint32_t slot, uint8_t opcode, int res) {
+  Op &op = ops[slot];
+  op.queued--;
+
+  switch (opcode) {
+    case IORING_OP_WRITE:
+      // try three times to write the file and then give up
+      if (res == -ENOSPC && ++op.tries < 3) {
+        sleep(10);
+        submitWrite(slot);
+        break;
+      }
+      if (res <= 0) {
+        errno = res ? -res : EIO;
+        logger.error("ERROR writing file");
+        break;
+      }
+
+      op.offset += res;
+      op.len -= res;
+      if (op.len > 0) {
+        op.tries = 0;
+        submitWrite(slot);
+      }
+      break;
+    case IORING_OP_STATX:
+      if (res < 0) {
+        errno = -res;
+        logger.error("ERROR getting attributes");
+      }
+      // keeps the capacity for the next path of the slot
+      op.path.clear();
+      break;
+    default:
+      // errors of fdatasync are ignored like before
+      break;
+  }
+
+  // the fdatasync of a write may still be running
+  if (!op.queued) release(slot);
+}
+
+unsigned IoRing::reap(bool wait) {
+  unsigned head = *cqHead;
+  unsigned count = 0;
+
+  if (wait && head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) enter(true);
+
+  while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &cqes[head & cqMask];
+    auto slot = static_cast<uint32_t>(cqe->user_data);
+    auto opcode = static_cast<uint8_t>(cqe->user_data >> 32);
+    int res = cqe->res;
+
+    // the entry is handed back before a retry is submitted
+    __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+    complete(slot, opcode, res);
+    count++;
+  }
+
+  return count;
+}
+
+void IoRing::write(tree::Node *node, uint64_t offset, uint64_t count,
+                   bool sync) {
+  while (count > 0) {
+    uint32_t slot = acquire(node);
+    Op &op = ops[slot];
+
+    op.sync = sync;
+    op.offset = offset;
+    op.len = std::min(static_cast<uint64_t>(dataSize), count);
+    offset += op.len;
+    count -= op.len;
+
+    submitWrite(slot);
+    if (!op.queued) release(slot);
+  }
+}
+
+void IoRing::statx(tree::Node *node) {
+  uint32_t slot = acquire(node);
+
+  // the path cache may change the string before the kernel reads it
+  Op &op = ops[slot];
+  op.path = node->calcPath();
+
+  reserve(1);
+  auto sqe = prepare(slot, IORING_OP_STATX);
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uint64_t>(op.path.c_str());
+  sqe->len = STATX_BASIC_STATS;
+  sqe->off = reinterpret_cast<uint64_t>(&ops[slot].buf);
+  sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+}
+
+void IoRing::wait(const tree::Node *node) {
+  while (!inflight.empty() && inflight.count(node)) reap(true);
+}
+
+void IoRing::drain() {
+  while (!inflight.empty()) reap(true);
+}
+
+#else
+
+IoRing::IoRing(unsigned, const void *data, uint32_t dataSize,
+               Logger &logger)
+    : logger(logger), data(data), dataSize(dataSize) {
+  throw IoRingException("IoRing: io_uring is not supported");
+}
+
+IoRing::~IoRing() {}
+
+void IoRing::enter(bool) {}
+
+unsigned IoRing::reap(bool) { return 0; }
+
+void IoRing::write(tree::Node *, uint64_t, uint64_t, bool) {}
+
+void IoRing::statx(tree::Node *) {}
+
+void IoRing::wait(const tree::Node *) {}
+
+void IoRing::drain() {}
+
+#endif /* IO_RING_SUPPORTED */
+
+}  // namespace replay
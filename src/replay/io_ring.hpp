@@ -0,0 +1,172 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPLAY_IO_RING_H_
+#define REPLAY_IO_RING_H_
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "display/logger.hpp"
+#include "tree/node.hpp"
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// the operations were added in Linux 5.6 together with this flag
+#ifdef IORING_FEAT_RW_CUR_POS
+#define IO_RING_SUPPORTED
+#else
+struct io_uring_sqe;
+struct io_uring_cqe;
+#endif
+
+namespace replay {
+
+/*
+ * Submits the writes and the attribute lookups of files to an io_uring
+ * instead of waiting for every system call. The ring is driven through
+ * the system calls directly, so it does not need liburing.
+ *
+ * The entries are queued and submitted at once by submit(), which the
+ * replay calls after every frame, and before waiting. The kernel takes
+ * its own reference of the descriptor on submission, so the entries are
+ * also submitted before the descriptor cache of the nodes closes one.
+ * The fdatasync after a write is linked to it, so both are submitted
+ * together and the kernel starts the fdatasync once the write is done.
+ * Kernels before 5.19 read the path of a
+ * statx only when it runs, so the path is kept in the operation until
+ * it completes. Opening, renaming and removing files stay synchronous.
+ *
+ * The operations in flight are counted per node. Before anything else
+ * touches the file of a node, wait() has to be called for the node, so
+ * the replay stays in the order of the trace for every file. Failed
+ * writes are logged, ENOSPC is retried like the synchronous writes.
+ */
+class IoRing {
+ private:
+  struct Op {
+    tree::Node *node;
+    // entries of the operation the kernel did not complete yet
+    uint8_t queued;
+    uint8_t tries;
+    // fdatasync after the write
+    bool sync;
+    uint32_t len;
+    uint64_t offset;
+    // relative to the working directory
+    std::string path;
+    struct statx buf;
+  };
+
+  Logger &logger;
+  const void *data;
+  uint32_t dataSize;
+  int fd = -1;
+
+  // the rings shared with the kernel
+  void *sqRing = nullptr;
+  void *cqRing = nullptr;
+  size_t sqRingSize = 0;
+  size_t cqRingSize = 0;
+  struct io_uring_sqe *sqes = nullptr;
+  size_t sqesSize = 0;
+  unsigned *sqTail;
+  unsigned sqMask;
+  unsigned sqEntries;
+  // entries prepared but not submitted yet
+  unsigned pending = 0;
+  unsigned *sqArray;
+  unsigned *cqHead;
+  unsigned *cqTail;
+  unsigned cqMask;
+  struct io_uring_cqe *cqes;
+
+  std::vector<Op> ops;
+  std::vector<uint32_t> freeOps;
+  // number of operations in flight per node
+  std::unordered_map<const tree::Node *, uint32_t> inflight;
+
+  void unmap();
+  uint32_t acquire(tree::Node *node);
+  void release(uint32_t slot);
+  // makes room for count entries in the submission ring
+  void reserve(unsigned count);
+  struct io_uring_sqe *prepare(uint32_t slot, uint8_t opcode);
+  // submits the pending entries and waits for a completion if wait is set
+  void enter(bool wait);
+  void submitWrite(uint32_t slot);
+  void complete(uint32_t slot, uint8_t opcode, int res);
+  // handles the finished operations and returns their number
+  unsigned reap(bool wait);
+
+ public:
+  /*
+   * At most depth operations are in flight. Writes are split into
+   * chunks of dataSize bytes, which are all taken from data. It has to
+   * stay valid while the ring exists.
+   */
+  IoRing(unsigned depth, const void *data, uint32_t dataSize,
+         Logger &logger);
+  ~IoRing();
+
+  IoRing(const IoRing &) = delete;
+  IoRing &operator=(const IoRing &) = delete;
+
+  // writes count bytes at offset to the file of node like pwrite(2)
+  void write(tree::Node *node, uint64_t offset, uint64_t count, bool sync);
+  // looks up the attributes of the file like lstat(2)
+  void statx(tree::Node *node);
+
+  // submits the queued operations
+  void submit() {
+    if (pending) enter(false);
+  }
+
+  // handles the operations that finished, without waiting
+  void poll() {
+    submit();
+    if (!inflight.empty()) reap(false);
+  }
+
+  // waits for the operations on the file of node
+  void wait(const tree::Node *node);
+  // waits for all operations
+  void drain();
+
+  [[nodiscard]] size_t size() const { return ops.size() - freeOps.size(); }
+
+  // whether operations on the file of node are in flight
+  bool contains(const tree::Node *node) const {
+    return inflight.count(node) != 0;
+  }
+
+  class IoRingException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+};
+
+}  // namespace replay
+
+#endif /* REPLAY_IO_RING_H_ */
@@ -18,7 +18,6 @@
 
 #include "replay/transaction_mgr.hpp"
 
-#include <unordered_map>
 #include <vector>
 
 #include "parser/frame.hpp"
@@ -29,16 +28,16 @@ using namespace parser;
 
 namespace replay {
 
-void TransactionMgr::processRequest(std::unique_ptr<const Frame> &&req) {
+void TransactionMgr::processRequest(FramePtr &&req) {
   switch (req->operation) {
     case LOOKUP:
     case CREATE:
     case MKDIR:
     case REMOVE:
     case RMDIR:
+      req->decode();
       if (!req->fh.empty() && !req->name.empty()) {
-        // Important: insert does not update value
-        transactions[req->xid] = std::move(req);
+        transactions.insert(std::move(req));
         return;
       }
       break;
@@ -46,31 +45,31 @@ void TransactionMgr::processRequest(std::unique_ptr<const Frame> &&req) {
     case GETATTR:
     case WRITE:
     case SETATTR:
+      req->decode();
       if (!req->fh.empty()) {
-        transactions[req->xid] = std::move(req);
-        ;
+        transactions.insert(std::move(req));
         return;
       }
       break;
     case RENAME:
+      req->decode();
       if (!req->fh.empty() && !req->fh2.empty() && !req->name.empty() &&
           !req->name2.empty()) {
-        transactions[req->xid] = std::move(req);
-        ;
+        transactions.insert(std::move(req));
         return;
       }
       break;
     case LINK:
+      req->decode();
       if (!req->fh.empty() && !req->fh2.empty() && !req->name.empty()) {
-        transactions[req->xid] = std::move(req);
-        ;
+        transactions.insert(std::move(req));
         return;
       }
       break;
     case SYMLINK:
+      req->decode();
       if (!req->fh.empty() && !req->name.empty() && !req->name2.empty()) {
-        transactions[req->xid] = std::move(req);
-        ;
+        transactions.insert(std::move(req));
         return;
       }
       break;
@@ -79,38 +78,22 @@ void TransactionMgr::processRequest(std::unique_ptr<const Frame> &&req) {
   }
 }
 
-void TransactionMgr::processResponse(std::unique_ptr<const Frame> &&res) {
-  auto transIt = transactions.find(res->xid);
-  if (transIt == transactions.end()) {
+void TransactionMgr::processResponse(FramePtr &&res) {
+  auto req = transactions.take(res->client, res->xid);
+  if (!req) {
     return;
   }
 
-  auto req = transIt->second.get();
-
   if (res->status != FOK || res->operation != req->operation ||
       res->time - req->time > GC_MAX_TRANSACTIONTIME) {
-    transactions.erase(transIt);
     return;
   }
 
-  engine.process(std::move(transIt->second), std::move(res));
-  transactions.erase(transIt);
+  res->decode();
+  engine.process(std::move(req), std::move(res));
 }
 
-void TransactionMgr::gc(int64_t time) {
-  int64_t trans_ko_time = time - GC_MAX_TRANSACTIONTIME;
-
-  // clear up old transactions
-  for (auto it = transactions.begin(), e = transactions.end(); it != e;) {
-    if (it->second->time < trans_ko_time) {
-      transactions.erase(it++);
-    } else {
-      ++it;
-    }
-  }
-}
-
-int TransactionMgr::process(std::unique_ptr<const Frame> &&frame) {
+int TransactionMgr::process(FramePtr &&frame) {
   int64_t time = frame->time;
 
   // Sync every 10 minutes
@@ -120,21 +103,23 @@ int TransactionMgr::process(std::unique_ptr<const Frame> &&frame) {
     last_sync = time;
   }
 
-  if (sett.enableGC &&
-      ((last_gc + 60 * 60 * 12 < time && engine.size() > GC_NODE_THRESHOLD) ||
-       engine.size() > GC_NODE_HARD_THRESHOLD)) {
-    logger.log("RUNNING GC");
-
-    engine.gc(time);
-    gc(time);
+  if (sett.enableGC && engine.size() > GC_NODE_THRESHOLD)
+    stats.nodesReclaimed += engine.gc(time);
 
-    last_gc = time;
+  if (sett.memoryLimit) {
+    if (engine.memoryUsage() > sett.memoryLimit)
+      stats.nodesSpilled += engine.spill(time);
+    stats.nodesLoaded = engine.loadedNodes();
   }
 
+  if (sett.coalesceWrites) stats.writesCoalesced = engine.coalescedWrites();
+
   if (sett.startTime < 0 && sett.startAfterDays > 0)
     sett.startTime = time + (sett.startAfterDays * 24 * 60 * 60);
 
   if (sett.startTime == -1 || sett.startTime < time) {
+    transactions.expire(time);
+
     if (frame->protocol == C3 || frame->protocol == C2) {
       stats.requestsProcessed++;
       processRequest(std::move(frame));
@@ -20,11 +20,12 @@
 #define TRANSACTIONMGR_H_
 
 #include <memory>
-#include <unordered_map>
 
 #include "display/logger.hpp"
 #include "parser/frame.hpp"
+#include "parser/frame_pool.hpp"
 #include "replay/engine.hpp"
+#include "replay/transaction_table.hpp"
 #include "settings.hpp"
 #include "stats.hpp"
 
@@ -40,23 +41,25 @@ class TransactionMgr {
   Stats &stats;
   Engine engine;
   Logger &logger;
-  // map transaction ids to frames
-  std::unordered_map<uint32_t, std::unique_ptr<const Frame>> transactions;
+  // pending requests by client and transaction id
+  TransactionTable transactions;
 
   int64_t last_sync = 0;
-  int64_t last_gc = 0;
 
-  void processRequest(std::unique_ptr<const Frame> &&req);
-  void processResponse(std::unique_ptr<const Frame> &&res);
+  void processRequest(parser::FramePtr &&req);
+  void processResponse(parser::FramePtr &&res);
 
  public:
   TransactionMgr(Settings &sett, Stats &stats, Logger &logger)
-      : sett(sett), stats(stats), engine(sett, logger), logger(logger) {}
+      : sett(sett),
+        stats(stats),
+        engine(sett, logger),
+        logger(logger),
+        transactions(GC_MAX_TRANSACTIONTIME) {}
 
   uint64_t size() { return engine.size(); }
 
-  int process(std::unique_ptr<const Frame> &&frame);
-  void gc(int64_t time);
+  int process(parser::FramePtr &&frame);
 };
 
 }  // namespace replay
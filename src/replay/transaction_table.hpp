@@ -0,0 +1,196 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPLAY_TRANSACTION_TABLE_H_
+#define REPLAY_TRANSACTION_TABLE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "parser/frame.hpp"
+#include "parser/frame_pool.hpp"
+
+namespace replay {
+
+/*
+ * initial number of slots of the transaction table, must be a power of 2
+ */
+#define TRANSACTION_TABLE_MIN_SIZE 1024
+
+/*
+ * Pending requests keyed by client and transaction id. The table uses
+ * open addressing with linear probing and stores the key next to the
+ * frame pointer, so a lookup scans a few adjacent 16 byte slots and
+ * touches the frame only if the key matches.
+ *
+ * Erasing shifts the following entries of the probe sequence back
+ * instead of leaving tombstones, so lookups never get slower after many
+ * insertions and deletions.
+ *
+ * Requests that are not answered within maxAge seconds are retired by a
+ * timing wheel with one bucket per second of trace time. Every insert
+ * adds the key to the bucket of its second and expire() only visits the
+ * buckets of the seconds that passed, so the cost depends on the number
+ * of requests that expire and not on the number of pending ones.
+ */
+class TransactionTable {
+ private:
+  using ConstFramePtr = parser::ConstFramePtr;
+
+  struct Slot {
+    uint64_t key;
+    // an empty slot has no frame
+    ConstFramePtr frame;
+  };
+
+  std::vector<Slot> slots;
+  size_t count = 0;
+  size_t mask;
+
+  int64_t maxAge;
+  // keys of the requests by the second they were inserted
+  std::vector<std::vector<uint64_t>> wheel;
+  // every request before this second has been expired
+  int64_t expired = std::numeric_limits<int64_t>::min();
+
+  static uint64_t makeKey(uint32_t client, uint32_t xid) {
+    return static_cast<uint64_t>(client) << 32 | xid;
+  }
+
+  size_t home(uint64_t key) const {
+    // the high bits of the product depend on all bits of the key
+    return (key * 0x9e3779b97f4a7c15ULL) >> 32 & mask;
+  }
+
+  // the slot of key or the empty slot where it would be inserted
+  size_t probe(uint64_t key) const {
+    size_t i = home(key);
+
+    while (slots[i].frame && slots[i].key != key) i = (i + 1) & mask;
+
+    return i;
+  }
+
+  void grow() {
+    std::vector<Slot> old(2 * slots.size());
+    old.swap(slots);
+    mask = slots.size() - 1;
+
+    for (auto &slot : old)
+      if (slot.frame) slots[probe(slot.key)] = std::move(slot);
+  }
+
+  // the bucket of the wheel that holds the keys of the given second
+  std::vector<uint64_t> &bucket(int64_t second) {
+    int64_t size = wheel.size();
+    return wheel[(second % size + size) % size];
+  }
+
+  // the frame of the slot may already be moved out
+  void eraseAt(size_t hole) {
+    slots[hole].frame.reset();
+    count--;
+
+    // move back entries that cannot be found across the hole anymore
+    for (size_t i = (hole + 1) & mask; slots[i].frame; i = (i + 1) & mask) {
+      size_t h = home(slots[i].key);
+
+      // the entry stays, if its home lies cyclically in (hole, i]
+      if (((i - h) & mask) < ((i - hole) & mask)) continue;
+
+      slots[hole] = std::move(slots[i]);
+      hole = i;
+    }
+  }
+
+ public:
+  // requests older than maxAge seconds are expired
+  explicit TransactionTable(int64_t maxAge)
+      : slots(TRANSACTION_TABLE_MIN_SIZE),
+        mask(TRANSACTION_TABLE_MIN_SIZE - 1),
+        maxAge(maxAge),
+        wheel(maxAge + 1) {}
+
+  [[nodiscard]] size_t size() const { return count; }
+
+  // replaces a pending request with the same key
+  void insert(ConstFramePtr &&req) {
+    // keep the load factor below 3/4
+    if (4 * (count + 1) > 3 * slots.size()) grow();
+
+    if (expired == std::numeric_limits<int64_t>::min())
+      expired = req->time - maxAge;
+    // the wheel only covers the seconds from expired on
+    if (req->time >= expired + static_cast<int64_t>(wheel.size()))
+      expire(req->time);
+
+    uint64_t key = makeKey(req->client, req->xid);
+    // requests that are out of order expire with the next second
+    bucket(std::max(req->time, expired)).push_back(key);
+
+    Slot &slot = slots[probe(key)];
+
+    if (!slot.frame) count++;
+    slot.key = key;
+    slot.frame = std::move(req);
+  }
+
+  // removes the pending request and returns it or nullptr
+  ConstFramePtr take(uint32_t client, uint32_t xid) {
+    size_t i = probe(makeKey(client, xid));
+    ConstFramePtr res = std::move(slots[i].frame);
+
+    if (res) eraseAt(i);
+
+    return res;
+  }
+
+  /*
+   * Removes the requests that are older than maxAge seconds at the
+   * given time. The keys in the buckets may belong to requests that
+   * were answered or replaced in the meantime, so the time of the
+   * request is checked again.
+   */
+  void expire(int64_t time) {
+    int64_t limit = time - maxAge;
+
+    if (limit <= expired) return;
+
+    // after a gap in the trace every bucket is visited only once
+    int64_t second = std::max(expired, limit - int64_t(wheel.size()));
+    for (; second < limit; ++second) {
+      auto &keys = bucket(second);
+
+      for (uint64_t key : keys) {
+        size_t i = probe(key);
+        if (slots[i].frame && slots[i].frame->time < limit) eraseAt(i);
+      }
+      keys.clear();
+    }
+
+    expired = limit;
+  }
+};
+
+}  // namespace replay
+
+#endif /* REPLAY_TRANSACTION_TABLE_H_ */
@@ -0,0 +1,146 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPLAY_WRITE_COALESCER_H_
+#define REPLAY_WRITE_COALESCER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "tree/node.hpp"
+
+namespace replay {
+
+/*
+ * Number of files with pending writes, the largest run of data that is
+ * written at once and the seconds of trace time a run stays pending.
+ */
+#define WRITE_COALESCE_STREAMS 16
+#define WRITE_COALESCE_BYTES (8 * 1024 * 1024)
+#define WRITE_COALESCE_AGE 1
+
+/*
+ * Merges the WRITE calls of the trace into fewer and larger writes. Every
+ * file has at most one pending run of data. A write that touches or
+ * overlaps the run of its file extends it, any other write to the file
+ * writes the run and starts a new one. The runs are written in the
+ * order they were started, when there are too many of them, when they
+ * grow too large or when they get too old.
+ *
+ * Overlapping writes are written only once, so the coalescer preserves
+ * the sizes and layout of the files but not the number of bytes the
+ * clients wrote.
+ */
+class WriteCoalescer {
+ public:
+  struct Run {
+    tree::Node *node;
+    uint64_t start;
+    uint64_t end;
+    // trace time of the first write of the run
+    int64_t time;
+  };
+
+  using WriteFunction = std::function<void(const Run &)>;
+
+ private:
+  // ordered by the time they were started
+  std::vector<Run> runs;
+  WriteFunction write;
+  uint64_t merged = 0;
+
+  void writeAt(size_t i) {
+    // the run is removed first, in case the write function flushes
+    Run run = runs[i];
+    runs.erase(runs.begin() + i);
+    write(run);
+  }
+
+  size_t find(const tree::Node *node) const {
+    size_t i = 0;
+    while (i < runs.size() && runs[i].node != node) ++i;
+    return i;
+  }
+
+ public:
+  explicit WriteCoalescer(WriteFunction write) : write(std::move(write)) {
+    runs.reserve(WRITE_COALESCE_STREAMS);
+  }
+
+  WriteCoalescer(const WriteCoalescer &) = delete;
+  WriteCoalescer &operator=(const WriteCoalescer &) = delete;
+
+  // adds a write of count bytes at offset to the file of node
+  void add(tree::Node *node, uint64_t offset, uint64_t count, int64_t time) {
+    if (count == 0) return;
+
+    uint64_t end = offset + count;
+    size_t i = find(node);
+
+    if (i < runs.size()) {
+      Run &run = runs[i];
+      uint64_t start = std::min(run.start, offset);
+      uint64_t last = std::max(run.end, end);
+
+      if (offset <= run.end && end >= run.start &&
+          last - start <= WRITE_COALESCE_BYTES) {
+        run.start = start;
+        run.end = last;
+        merged++;
+        return;
+      }
+
+      writeAt(i);
+    }
+
+    if (runs.size() == WRITE_COALESCE_STREAMS) writeAt(0);
+
+    runs.push_back({node, offset, end, time});
+  }
+
+  // writes the pending run of node, before its file changes otherwise
+  void flush(const tree::Node *node) {
+    size_t i = find(node);
+    if (i < runs.size()) writeAt(i);
+  }
+
+  // writes the runs that were started before time
+  void flushBefore(int64_t time) {
+    while (!runs.empty() && runs.front().time < time) writeAt(0);
+  }
+
+  void flushAll() {
+    while (!runs.empty()) writeAt(0);
+  }
+
+  size_t pending() const { return runs.size(); }
+
+  bool contains(const tree::Node *node) const {
+    return find(node) < runs.size();
+  }
+
+  // number of writes that were merged into a pending run
+  uint64_t coalesced() const { return merged; }
+};
+
+}  // namespace replay
+
+#endif /* REPLAY_WRITE_COALESCER_H_ */
@@ -62,6 +62,10 @@ class Settings {
   int syncMinutes = 10;
   bool noSync = false;
   bool dataSync = false;
+  // merges sequential writes into larger ones
+  bool coalesceWrites = false;
+  // operations in flight in the io_uring, 0 replays synchronously
+  unsigned ringDepth = 0;
   bool inodeTest = false;
   bool enableGC = true;
   std::string reportPath;
@@ -70,6 +74,10 @@ class Settings {
   int startAfterDays = -1;
   int endAfterDays = -1;
   int syncFd = -1;
+  // 0 parses on one thread per core
+  unsigned parseThreads = 0;
+  // bytes for the nodes of the tree, 0 is unlimited
+  uint64_t memoryLimit = 0;
 
   void setStartTime(const char *time) {
     startTime = parseTime(time);
@@ -37,6 +37,10 @@ class Stats {
   unsigned long long renameOperations = 0;
   unsigned long long writeOperations = 0;
   unsigned long long createOperations = 0;
+  unsigned long long nodesReclaimed = 0;
+  unsigned long long nodesSpilled = 0;
+  unsigned long long nodesLoaded = 0;
+  unsigned long long writesCoalesced = 0;
 
   void writeReport(const std::string &path) {
     if (path.empty()) return;
@@ -53,6 +57,15 @@ class Stats {
     fprintf(fd, "RenameOperations %llu\n", renameOperations);
     fprintf(fd, "WriteOperations %llu\n", writeOperations);
     fprintf(fd, "CreateOperations %llu\n", createOperations);
+    fprintf(fd, "NodesReclaimed %llu\n", nodesReclaimed);
+    fprintf(fd, "NodesSpilled %llu\n", nodesSpilled);
+    fprintf(fd, "NodesLoaded %llu\n", nodesLoaded);
+    fprintf(fd, "WritesCoalesced %llu\n", writesCoalesced);
+    fprintf(fd, "FileHandles %llu\n",
+            (unsigned long long)parser::FileHandle::count());
+    fprintf(fd, "LegacyFileHandleCollisions %llu\n",
+            (unsigned long long)parser::FileHandle::legacyCollisions());
+    fprintf(fd, "Names %llu\n", (unsigned long long)parser::Name::count());
     fclose(fd);
   }
 
@@ -0,0 +1,198 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TREE_CHILD_INDEX_H_
+#define TREE_CHILD_INDEX_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "parser/name.hpp"
+
+namespace tree {
+
+class Node;
+
+/*
+ * directories with more children than this are indexed by a hash table
+ */
+#define CHILD_INDEX_SMALL_MAX 32
+
+/*
+ * The children of a directory by name. Small directories keep the
+ * children in a vector sorted by name, which is searched with a few
+ * comparisons in a single cache line or two. Directories with more
+ * than CHILD_INDEX_SMALL_MAX children switch to an open addressing hash
+ * table with linear probing over the same vector, so lookups in huge
+ * directories like mail spools stay O(1). A directory only switches
+ * back once it shrinks to a quarter of that.
+ */
+class ChildIndex {
+ private:
+  using Name = parser::Name;
+
+  struct Entry {
+    // an empty slot of the hash table has an empty name
+    Name name;
+    Node *node;
+  };
+
+  std::vector<Entry> entries;
+  size_t count = 0;
+  bool hashed = false;
+
+  static bool less(const Entry &e, const Name &name) { return e.name < name; }
+
+  [[nodiscard]] size_t mask() const { return entries.size() - 1; }
+
+  // the slot of name or the empty slot where it would be inserted
+  [[nodiscard]] size_t probe(const Name &name) const {
+    size_t i = name.hash() & mask();
+
+    while (!entries[i].name.empty() && entries[i].name != name)
+      i = (i + 1) & mask();
+
+    return i;
+  }
+
+  void rehash(size_t size) {
+    std::vector<Entry> old(size);
+    old.swap(entries);
+    hashed = true;
+
+    for (auto &e : old)
+      if (!e.name.empty()) entries[probe(e.name)] = e;
+  }
+
+  void unhash() {
+    std::vector<Entry> small;
+    small.reserve(CHILD_INDEX_SMALL_MAX);
+
+    for (auto &e : entries)
+      if (!e.name.empty()) small.push_back(e);
+
+    std::sort(small.begin(), small.end(),
+              [](const Entry &a, const Entry &b) { return a.name < b.name; });
+    entries.swap(small);
+    hashed = false;
+  }
+
+ public:
+  // iterates over the children, skipping the empty slots
+  class Iterator {
+   private:
+    const Entry *pos;
+    const Entry *end;
+
+    void skip() {
+      while (pos != end && pos->name.empty()) ++pos;
+    }
+
+   public:
+    Iterator(const Entry *pos, const Entry *end) : pos(pos), end(end) {
+      skip();
+    }
+
+    Node *operator*() const { return pos->node; }
+    bool operator!=(const Iterator &other) const { return pos != other.pos; }
+    Iterator &operator++() {
+      ++pos;
+      skip();
+      return *this;
+    }
+  };
+
+  [[nodiscard]] Iterator begin() const {
+    return Iterator(entries.data(), entries.data() + entries.size());
+  }
+  [[nodiscard]] Iterator end() const {
+    return Iterator(entries.data() + entries.size(),
+                    entries.data() + entries.size());
+  }
+
+  [[nodiscard]] size_t size() const { return count; }
+  [[nodiscard]] bool empty() const { return count == 0; }
+
+  [[nodiscard]] Node *find(const Name &name) const {
+    if (hashed) {
+      const Entry &e = entries[probe(name)];
+      return e.name.empty() ? nullptr : e.node;
+    }
+
+    auto it = std::lower_bound(entries.begin(), entries.end(), name, less);
+    return it != entries.end() && it->name == name ? it->node : nullptr;
+  }
+
+  // the name must not be present yet
+  void insert(const Name &name, Node *node) {
+    count++;
+
+    if (!hashed && count > CHILD_INDEX_SMALL_MAX)
+      rehash(4 * CHILD_INDEX_SMALL_MAX);
+    else if (hashed && 2 * count > entries.size())
+      rehash(2 * entries.size());
+
+    if (hashed) {
+      entries[probe(name)] = Entry{name, node};
+    } else {
+      auto it = std::lower_bound(entries.begin(), entries.end(), name, less);
+      entries.insert(it, Entry{name, node});
+    }
+  }
+
+  // returns false if the name is not present
+  bool erase(const Name &name) {
+    if (!hashed) {
+      auto it = std::lower_bound(entries.begin(), entries.end(), name, less);
+      if (it == entries.end() || it->name != name) return false;
+
+      entries.erase(it);
+      count--;
+      return true;
+    }
+
+    size_t hole = probe(name);
+    if (entries[hole].name.empty()) return false;
+
+    entries[hole].name.clear();
+    count--;
+
+    // move back entries that cannot be found across the hole anymore
+    for (size_t i = (hole + 1) & mask(); !entries[i].name.empty();
+         i = (i + 1) & mask()) {
+      size_t h = entries[i].name.hash() & mask();
+
+      // the entry stays, if its home lies cyclically in (hole, i]
+      if (((i - h) & mask()) < ((i - hole) & mask())) continue;
+
+      entries[hole] = entries[i];
+      entries[i].name.clear();
+      hole = i;
+    }
+
+    if (4 * count < CHILD_INDEX_SMALL_MAX) unhash();
+
+    return true;
+  }
+};
+
+}  // namespace tree
+
+#endif /* TREE_CHILD_INDEX_H_ */
@@ -0,0 +1,143 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TREE_DIR_FD_CACHE_H_
+#define TREE_DIR_FD_CACHE_H_
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tree {
+
+/*
+ * Least recently used set of open directory descriptors, keyed by the
+ * node they belong to. The cache owns the descriptors and closes them
+ * when they are evicted or erased. A lookup or insert makes the entry
+ * the most recently used one, so with a capacity of at least two the
+ * descriptors returned by the last two calls are always open.
+ */
+class DirFdCache {
+ private:
+  struct Entry {
+    const void *key;
+    int fd;
+    // neighbours in the list, entry 0 is its head
+    uint32_t prev;
+    uint32_t next;
+  };
+
+  std::vector<Entry> entries;
+  std::unordered_map<const void *, uint32_t> index;
+  std::vector<uint32_t> unused;
+  std::function<void()> beforeClose;
+
+  void unlink(uint32_t i) {
+    entries[entries[i].prev].next = entries[i].next;
+    entries[entries[i].next].prev = entries[i].prev;
+  }
+
+  void pushFront(uint32_t i) {
+    entries[i].prev = 0;
+    entries[i].next = entries[0].next;
+    entries[entries[0].next].prev = i;
+    entries[0].next = i;
+  }
+
+ public:
+  explicit DirFdCache(size_t capacity) : entries(capacity + 1) {
+    if (capacity < 2) throw DirFdCacheException("tree::DirFdCache: Too small");
+
+    entries[0].prev = entries[0].next = 0;
+    index.reserve(capacity);
+    for (size_t i = capacity; i > 0; --i) unused.push_back(i);
+  }
+
+  ~DirFdCache() {
+    for (auto &e : index) close(entries[e.second].fd);
+  }
+
+  DirFdCache(const DirFdCache &) = delete;
+  DirFdCache &operator=(const DirFdCache &) = delete;
+
+  // returns the descriptor of key or -1
+  int find(const void *key) {
+    auto it = index.find(key);
+    if (it == index.end()) return -1;
+
+    unlink(it->second);
+    pushFront(it->second);
+    return entries[it->second].fd;
+  }
+
+  // key must not be in the cache yet
+  void insert(const void *key, int fd) {
+    uint32_t i;
+
+    if (unused.empty()) {
+      i = entries[0].prev;
+      unlink(i);
+      index.erase(entries[i].key);
+      if (beforeClose) beforeClose();
+      close(entries[i].fd);
+    } else {
+      i = unused.back();
+      unused.pop_back();
+    }
+
+    entries[i].key = key;
+    entries[i].fd = fd;
+    pushFront(i);
+    index.emplace(key, i);
+  }
+
+  void erase(const void *key) {
+    if (index.empty()) return;
+
+    auto it = index.find(key);
+    if (it == index.end()) return;
+
+    uint32_t i = it->second;
+    unlink(i);
+    if (beforeClose) beforeClose();
+    close(entries[i].fd);
+    index.erase(it);
+    unused.push_back(i);
+  }
+
+  [[nodiscard]] size_t size() const { return index.size(); }
+
+  // called before a descriptor is evicted or erased
+  void setBeforeClose(std::function<void()> hook) {
+    beforeClose = std::move(hook);
+  }
+
+  class DirFdCacheException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+};
+
+}  // namespace tree
+
+#endif /* TREE_DIR_FD_CACHE_H_ */
@@ -0,0 +1,234 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tree/file_handle_map.hpp"
+
+#include <type_traits>
+
+namespace tree {
+
+void FileHandleMap::enableSpill(const std::string &dir) {
+  static_assert(std::is_trivially_copyable<Entry>::value,
+                "FileHandleMap: Entries are written as they are");
+
+  // handles and names are interned for good, so the entries keep them
+  spillDir = dir;
+  spillStore = std::make_unique<NodeStore>(dir);
+  Node::store = this;
+}
+
+// number of nodes below node or 0 if they cannot be spilled
+size_t FileHandleMap::spillable(Node *node, int64_t before, size_t limit,
+                                const Busy &busy) {
+  size_t n = 0;
+
+  for (auto child : *node->children) {
+    if (child->last_access >= before || ++n > limit) return 0;
+    if (busy && busy(child)) return 0;
+
+    // no hard links
+    if (slots[probe(child->fh)].head != child || child->nextLink) return 0;
+
+    if (!child->spilled && child->hasChildren()) {
+      size_t m = spillable(child, before, limit - n, busy);
+      if (!m) return 0;
+      n += m;
+    }
+  }
+
+  return n;
+}
+
+uint64_t FileHandleMap::spillCold(int64_t before, const Busy &busy) {
+  for (int i = 0; i < SPILL_SCAN_SLOTS; ++i) {
+    cursor = (cursor + 1) & mask;
+
+    Node *node = slots[cursor].head;
+    if (!node || isSpilled(node) || node->nextLink || node->spilled ||
+        !node->hasChildren() || node->last_access >= before)
+      continue;
+
+    // spill the biggest cold subtree
+    Node *top = node;
+    while (top->parent && top->parent->last_access < before)
+      top = top->parent;
+
+    size_t n = spillable(top, before, SPILL_MAX_NODES, busy);
+    if (!n && top != node) {
+      top = node;
+      n = spillable(top, before, SPILL_MAX_NODES, busy);
+    }
+
+    if (n) {
+      spill(top);
+      return n;
+    }
+  }
+
+  return 0;
+}
+
+void FileHandleMap::writeEntries(Node *node, std::vector<Entry> &entries,
+                                 std::vector<Node *> &nodes) {
+  for (auto child : *node->children) {
+    Entry e{child->fh,         child->name,  child->size,
+            child->last_access, 0,           noRecord,
+            0,                  child->created, child->dir};
+
+    nodes.push_back(child);
+
+    if (child->spilled) {
+      e.record = stubs[child];
+      e.createdChildren = child->createdChildren;
+      entries.push_back(e);
+    } else if (child->children) {
+      e.children = child->children->size();
+      entries.push_back(e);
+      writeEntries(child, entries, nodes);
+    } else {
+      entries.push_back(e);
+    }
+  }
+}
+
+void FileHandleMap::spill(Node *dir) {
+  std::vector<Entry> entries;
+  std::vector<Node *> nodes;
+
+  writeEntries(dir, entries, nodes);
+
+  uint32_t id;
+  if (unusedRecords.empty()) {
+    id = records.size();
+    records.emplace_back();
+  } else {
+    id = unusedRecords.back();
+    unusedRecords.pop_back();
+  }
+
+  auto &record = records[id];
+  record.offset =
+      spillStore->append(entries.data(), entries.size() * sizeof(Entry));
+  record.length = entries.size();
+  record.children = dir->children->size();
+  record.stub = dir;
+  record.outer = noRecord;
+
+  for (auto node : nodes) {
+    if (node->spilled) {
+      auto it = stubs.find(node);
+      records[it->second].stub = nullptr;
+      records[it->second].outer = id;
+      stubs.erase(it);
+    }
+
+    slots[probe(node->fh)].head = spilledHead(id);
+    delete node;
+  }
+
+  count -= nodes.size();
+  spilledCount += nodes.size();
+
+  // the counter of created children stays
+  dir->children.reset();
+  dir->spilled = true;
+  stubs[dir] = id;
+}
+
+void FileHandleMap::attachEntries(Node *parent, uint32_t n,
+                                  const std::vector<Entry> &entries,
+                                  size_t &pos) {
+  for (uint32_t i = 0; i < n; ++i) {
+    const Entry &e = entries[pos++];
+    auto node = new Node(e.fh, e.name, e.lastAccess);
+
+    node->size = e.size;
+    node->created = e.created;
+    node->dir = e.dir;
+    slots[probe(e.fh)].head = node;
+    parent->addChild(node);
+
+    if (e.record != noRecord) {
+      node->spilled = true;
+      node->createdChildren = e.createdChildren;
+      stubs[node] = e.record;
+      records[e.record].stub = node;
+      records[e.record].outer = noRecord;
+    } else {
+      attachEntries(node, e.children, entries, pos);
+    }
+
+    node->updateReclaimable();
+  }
+}
+
+void FileHandleMap::load(Node *stub) {
+  auto it = stubs.find(stub);
+  uint32_t id = it->second;
+  stubs.erase(it);
+
+  Record record = records[id];
+  std::vector<Entry> entries(record.length);
+  spillStore->read(record.offset, entries.data(),
+                   entries.size() * sizeof(Entry));
+
+  records[id].length = 0;
+  unusedRecords.push_back(id);
+
+  // addChild() counts the created children again
+  stub->spilled = false;
+  stub->createdChildren = 0;
+
+  size_t pos = 0;
+  attachEntries(stub, record.children, entries, pos);
+
+  count += entries.size();
+  spilledCount -= entries.size();
+  loadedCount += entries.size();
+  deadEntries += entries.size();
+
+  if (deadEntries > SPILL_COMPACT_NODES && deadEntries > spilledCount)
+    compact();
+}
+
+void FileHandleMap::loadRecord(uint32_t record) {
+  // the stub of a nested record is in the outer record
+  while (!records[record].stub) record = records[record].outer;
+
+  load(records[record].stub);
+}
+
+void FileHandleMap::compact() {
+  auto store = std::make_unique<NodeStore>(spillDir);
+  std::vector<Entry> entries;
+
+  for (auto &record : records) {
+    if (!record.length) continue;
+
+    entries.resize(record.length);
+    spillStore->read(record.offset, entries.data(),
+                     entries.size() * sizeof(Entry));
+    record.offset =
+        store->append(entries.data(), entries.size() * sizeof(Entry));
+  }
+
+  spillStore = std::move(store);
+  deadEntries = 0;
+}
+
+}  // namespace tree
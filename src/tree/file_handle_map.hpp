@@ -19,43 +19,210 @@
 #ifndef FILEHANDLEMAP_H_
 #define FILEHANDLEMAP_H_
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "parser/file_handle.hpp"
 #include "tree/node.hpp"
+#include "tree/node_store.hpp"
 
 namespace tree {
 
+/*
+ * number of slots the spilling looks at per call
+ */
+#define SPILL_SCAN_SLOTS 1024
+
+/*
+ * maximum number of nodes spilled at once
+ */
+#define SPILL_MAX_NODES (64 * 1024)
+
+/*
+ * the spill file is compacted once it holds this many dead nodes and
+ * more dead than live ones
+ */
+#define SPILL_COMPACT_NODES (1024 * 1024)
+
+/*
+ * Maps file handles to the nodes of the tree. The table uses open
+ * addressing with linear probing over 16 byte slots, which hold the
+ * interned handle and the first node with that handle. Hard links share
+ * the handle, so every further node is chained to the first one through
+ * Node::nextLink. Removing a node only walks the chain of its handle.
+ *
+ * The map owns the nodes. Erasing shifts the following entries of the
+ * probe sequence back instead of leaving tombstones.
+ *
+ * Cold subtrees can be spilled to a NodeStore. The root of the subtree
+ * stays in memory as a stub without children and the slots of the
+ * spilled handles point to their record instead of a node. Looking up
+ * such a handle or the children of the stub loads the whole record back.
+ * The records may contain stubs of earlier records, which are loaded
+ * first then. Subtrees with hard links are never spilled.
+ */
 class FileHandleMap {
- private:
-  std::unordered_multimap<parser::FileHandle, std::unique_ptr<tree::Node>> map;
+ public:
+  // tells the spilling that a node is still in use
+  using Busy = std::function<bool(const Node *)>;
 
+ private:
   using FileHandle = parser::FileHandle;
 
- public:
-  auto begin() { return map.begin(); }
+  struct Slot {
+    FileHandle fh;
+    // an empty slot has no node
+    tree::Node *head = nullptr;
+  };
 
-  auto end() { return map.end(); }
+  // a record of spilled nodes, which are stored in preorder
+  struct Record {
+    uint64_t offset;
+    // number of nodes, 0 for an unused record
+    uint32_t length;
+    // number of children of the stub
+    uint32_t children;
+    Node *stub;
+    // the record with the stub if it is spilled itself
+    uint32_t outer;
+  };
+
+  // a spilled node
+  struct Entry {
+    FileHandle fh;
+    Node::Name name;
+    uint64_t size;
+    int64_t lastAccess;
+    // number of children following the entry
+    uint32_t children;
+    // the record of the children of a stub or noRecord
+    uint32_t record;
+    uint32_t createdChildren;
+    bool created;
+    bool dir;
+  };
+
+  static constexpr uint32_t noRecord = UINT32_MAX;
+
+  std::vector<Slot> slots;
+  uint64_t count = 0;
+  size_t mask;
+
+  std::string spillDir;
+  std::unique_ptr<NodeStore> spillStore;
+  std::vector<Record> records;
+  std::vector<uint32_t> unusedRecords;
+  std::unordered_map<const Node *, uint32_t> stubs;
+  uint64_t spilledCount = 0;
+  uint64_t deadEntries = 0;
+  uint64_t loadedCount = 0;
+  size_t cursor = 0;
+
+  // slots of spilled handles hold the record with the lowest bit set
+  static bool isSpilled(const Node *head) {
+    return reinterpret_cast<uintptr_t>(head) & 1;
+  }
+
+  static Node *spilledHead(uint32_t record) {
+    return reinterpret_cast<Node *>((uintptr_t(record) << 1) | 1);
+  }
+
+  static uint32_t recordOf(const Node *head) {
+    return reinterpret_cast<uintptr_t>(head) >> 1;
+  }
+
+  size_t spillable(Node *node, int64_t before, size_t limit,
+                   const Busy &busy);
+  void spill(Node *dir);
+  void writeEntries(Node *node, std::vector<Entry> &entries,
+                    std::vector<Node *> &nodes);
+  void attachEntries(Node *parent, uint32_t n,
+                     const std::vector<Entry> &entries, size_t &pos);
+  void loadRecord(uint32_t record);
+  void compact();
+
+  size_t home(const FileHandle &fh) const { return fh.hash() & mask; }
+
+  // the slot of fh or the empty slot where it would be inserted
+  size_t probe(const FileHandle &fh) const {
+    size_t i = home(fh);
+
+    while (slots[i].head && slots[i].fh != fh) i = (i + 1) & mask;
+
+    return i;
+  }
+
+  void grow() {
+    std::vector<Slot> old(2 * slots.size());
+    old.swap(slots);
+    mask = slots.size() - 1;
+
+    for (auto &slot : old)
+      if (slot.head) slots[probe(slot.fh)] = slot;
+  }
+
+  void eraseAt(size_t hole) {
+    slots[hole].head = nullptr;
+
+    for (size_t i = (hole + 1) & mask; slots[i].head; i = (i + 1) & mask) {
+      size_t h = home(slots[i].fh);
+
+      // the entry stays, if its home lies cyclically in (hole, i]
+      if (((i - h) & mask) < ((i - hole) & mask)) continue;
+
+      slots[hole] = slots[i];
+      slots[i].head = nullptr;
+      hole = i;
+    }
+  }
+
+  // the most recently added node with a handle is found first
+  void insert(tree::Node *node) {
+    // keep the load factor below 3/4
+    if (4 * (count + spilledCount + 1) > 3 * slots.size()) grow();
+
+    Slot &slot = slots[probe(node->getHandle())];
+    while (isSpilled(slot.head)) loadRecord(recordOf(slot.head));
+
+    node->nextLink = slot.head;
+    slot.fh = node->getHandle();
+    slot.head = node;
+    count++;
+  }
+
+ public:
+  template <typename F>
+  void forEachNode(F f) {
+    for (auto &slot : slots) {
+      if (isSpilled(slot.head)) continue;
+      for (auto node = slot.head; node; node = node->nextLink) f(node);
+    }
+  }
 
   tree::Node *getNode(const FileHandle &fh) {
-    auto it = map.find(fh);
-    if (it == map.end()) return nullptr;
+    Slot &slot = slots[probe(fh)];
+    while (isSpilled(slot.head)) loadRecord(recordOf(slot.head));
 
-    return it->second.get();
+    return slot.head;
   }
 
   std::unique_ptr<tree::Node> removeNode(tree::Node *element) {
-    auto range = map.equal_range(element->getHandle());
-
-    for (auto it = range.first, e = range.second; it != e; ++it) {
-      if (it->second.get() == element) {
-        // First copy the node
-        auto node = std::move(it->second);
-        // Second erase the map entry
-        map.erase(it);
-        return node;
+    size_t i = probe(element->getHandle());
+
+    for (auto link = &slots[i].head; *link; link = &(*link)->nextLink) {
+      if (*link == element) {
+        *link = element->nextLink;
+        element->nextLink = nullptr;
+        count--;
+
+        if (!slots[i].head) eraseAt(i);
+        return std::unique_ptr<tree::Node>(element);
       }
     }
 
@@ -65,14 +232,14 @@ class FileHandleMap {
   void switchNodeHandle(tree::Node *node, const FileHandle &fh) {
     auto it = removeNode(node);
     node->setHandle(fh);
-    map.emplace(fh, std::move(it));
+    insert(it.release());
   }
 
   template <class... Args>
   tree::Node *createNode(const FileHandle &fh, Args &&... args) {
-    auto it = map.emplace(
-        fh, std::make_unique<tree::Node>(fh, std::forward<Args>(args)...));
-    return it->second.get();
+    auto node = std::make_unique<tree::Node>(fh, std::forward<Args>(args)...);
+    insert(node.get());
+    return node.release();
   }
 
   template <class... Args>
@@ -95,9 +262,56 @@ class FileHandleMap {
     return node;
   }
 
-  FileHandleMap(uint64_t reserve) { map.reserve(reserve); }
+  // reserve is the expected number of handles, the table grows as needed
+  explicit FileHandleMap(uint64_t reserve = 0) {
+    size_t size = 16;
+    while (3 * size < 4 * reserve) size *= 2;
+
+    slots.resize(size);
+    mask = size - 1;
+  }
 
-  uint64_t size() const { return map.size(); }
+  ~FileHandleMap() {
+    if (Node::store == this) Node::store = nullptr;
+
+    for (auto &slot : slots) {
+      if (isSpilled(slot.head)) continue;
+
+      for (auto node = slot.head; node;) {
+        auto next = node->nextLink;
+        delete node;
+        node = next;
+      }
+    }
+  }
+
+  FileHandleMap(const FileHandleMap &) = delete;
+  FileHandleMap &operator=(const FileHandleMap &) = delete;
+
+  // number of nodes in memory including every hard link
+  uint64_t size() const { return count; }
+
+  // keeps spilled nodes in a file in dir
+  void enableSpill(const std::string &dir);
+
+  /*
+   * Spills a subtree which was not accessed since before, if one is
+   * found in the next few slots. Subtrees with a node for which busy
+   * returns true are skipped. Returns the number of spilled nodes.
+   */
+  uint64_t spillCold(int64_t before, const Busy &busy = nullptr);
+
+  // loads the children of a stub
+  void load(Node *stub);
+
+  [[nodiscard]] uint64_t spilled() const { return spilledCount; }
+  // bytes of the table and of the records, the nodes are not included
+  [[nodiscard]] uint64_t memory() const {
+    return slots.size() * sizeof(Slot) + records.size() * sizeof(Record) +
+           unusedRecords.size() * sizeof(uint32_t) +
+           stubs.size() * 4 * sizeof(void *);
+  }
+  [[nodiscard]] uint64_t loaded() const { return loadedCount; }
 
   class FileHandleMapException : public std::runtime_error {
     using std::runtime_error::runtime_error;
@@ -24,14 +24,119 @@
 
 #include <cerrno>
 #include <cstring>
-#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "display/logger.hpp"
+#include "tree/dir_fd_cache.hpp"
+#include "tree/file_handle_map.hpp"
+#include "tree/slab.hpp"
 
 namespace tree {
 
 Logger *Node::logger;
+const Node::Children Node::noChildren;
+Node *Node::lruFirst;
+Node *Node::lruLast;
+FileHandleMap *Node::store;
+
+static Slab<Node, NODE_SLAB_CHUNK> nodeSlab;
+
+/*
+ * Direct mapped cache of the paths of recently used nodes. Moving or
+ * renaming a node stamps it with the next tick of the path clock, and
+ * a cached path is valid while no node on it was stamped after the path
+ * was computed. So a move only invalidates the paths below the node.
+ */
+struct CachedPath {
+  const void *node = nullptr;
+  uint64_t computed = 0;
+  std::string path;
+};
+
+static std::vector<CachedPath> pathCache(NODE_PATH_CACHE_SIZE);
+static uint64_t pathClock = 0;
+static uint64_t pathMisses = 0;
+
+static CachedPath &cachedPath(const void *node) {
+  // nodes are at least 64 bytes apart
+  auto i = reinterpret_cast<uintptr_t>(node) >> 6;
+  return pathCache[(i ^ (i >> 12)) & (NODE_PATH_CACHE_SIZE - 1)];
+}
+
+/*
+ * The kernel walks only the last component of a path relative to an
+ * open directory. Moved directories keep their descriptors, removed
+ * ones drop them.
+ */
+static DirFdCache dirFds(NODE_DIR_FD_CACHE_SIZE);
+
+/*
+ * Streaming writes to a file reuse its descriptor. A descriptor follows
+ * its file through renames, so only removing the file closes it.
+ */
+static DirFdCache fileFds(NODE_FILE_FD_CACHE_SIZE);
+
+// the slab only holds nodes, subclasses would not fit
+void *Node::operator new(size_t) { return nodeSlab.allocate(); }
+
+void Node::operator delete(void *ptr) {
+  // the slab reuses the memory for another node
+  auto &cached = cachedPath(ptr);
+  if (cached.node == ptr) cached.node = nullptr;
+  dirFds.erase(ptr);
+  fileFds.erase(ptr);
+
+  nodeSlab.deallocate(ptr);
+}
+
+void Node::closeFds() {
+  dirFds.erase(this);
+  fileFds.erase(this);
+}
+
+int Node::dirFd() {
+  int fd = dirFds.find(this);
+  if (fd != -1) return fd;
+
+  fd = open(calcPath().c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (fd != -1) dirFds.insert(this, fd);
+
+  return fd;
+}
+
+int Node::removeEntry() {
+  int fd = parentFd();
+
+  const std::string entry = name.str();
+  if (unlinkat(fd, entry.c_str(), 0) &&
+      (errno != EISDIR || unlinkat(fd, entry.c_str(), AT_REMOVEDIR)))
+    return -1;
+
+  closeFds();
+  return 0;
+}
+
+int Node::openFile(int flags) {
+  int fd = fileFds.find(this);
+  if (fd != -1) {
+    if ((flags & O_TRUNC) && ftruncate(fd, 0)) return -1;
+    return fd;
+  }
+
+  fd = openat(parentFd(), name.str().c_str(), flags | O_RDWR | O_CLOEXEC,
+              S_IRUSR | S_IWUSR);
+  if (fd != -1) fileFds.insert(this, fd);
+
+  return fd;
+}
+
+void Node::setBeforeFileClose(std::function<void()> hook) {
+  fileFds.setBeforeClose(std::move(hook));
+}
+
+void Node::pathChanged() { moved = ++pathClock; }
 
 void Node::writeToSize(uint64_t size) {
   auto curr = getSize();
@@ -39,7 +144,8 @@ void Node::writeToSize(uint64_t size) {
   if (created) {
     if (curr == size) return;
 
-    if (truncate(calcPath().c_str(), size) == 0) return;
+    int fd = openFile(0);
+    if (fd != -1 && ftruncate(fd, size) == 0) return;
   }
 
   int mode = O_RDWR | O_CREAT;
@@ -56,8 +162,7 @@ void Node::writeToSize(uint64_t size) {
   int i, fd = -1;
   // try three times to open the file and then give up
   for (i = 0; i < 3; ++i) {
-    if ((fd = open(calcPath().c_str(), mode, S_IRUSR | S_IWUSR)) != -1 ||
-        errno != ENOSPC)
+    if ((fd = openFile(mode)) != -1 || errno != ENOSPC)
       break;
     sleep(10);
   }
@@ -67,41 +172,32 @@ void Node::writeToSize(uint64_t size) {
     return;
   }
 
-  created = true;
+  setCreated(true);
 
   if (ftruncate(fd, size)) {
     if (errno == EPERM) {
-      if (lseek(fd, size - 1, SEEK_SET) == -1) {
-        logger->error("ERROR seeking file");
-      } else {
-        if (write(fd, "w", 1) != 1) logger->error("ERROR writing file");
-      }
+      if (pwrite(fd, "w", 1, size - 1) != 1)
+        logger->error("ERROR writing file");
     } else {
       logger->error("ERROR truncating file");
     }
   }
-
-  close(fd);
 }
 
-Node *Node::getChild(const std::string &name) const {
-  auto it = children.find(name);
-  if (it == children.end()) return nullptr;
-  return it->second;
-}
+void Node::load() { store->load(this); }
 
-bool Node::isChildCreated() const {
-  for (const auto &it : children) {
-    if (it.second->isCreated()) return true;
-  }
-  return false;
+Node *Node::getChild(const Name &name) {
+  loadChildren();
+  if (!children) return nullptr;
+
+  return children->find(name);
 }
 
 void Node::clearEmptyDir() {
   Node *el = this;
   do {
-    if (el->isCreated() && (!el->hasChildren() || !el->isChildCreated())) {
-      if (remove(el->calcPath().c_str())) {
+    if (el->isCreated() && !el->isChildCreated()) {
+      if (el->removeEntry()) {
         logger->error("ERROR recursive remove");
         break;
       } else {
@@ -118,21 +214,27 @@ void Node::removeChild(Node *child) {
   if (!child || this == child || fh == child->fh)
     throw NodeException("tree::Node: Wrong parameter");
 
-  auto it = children.find(child->name);
-  if (it == children.end() || it->second != child)
+  loadChildren();
+  if (!children || children->find(child->name) != child)
     throw NodeException("tree::Node: Cannot find element");
 
-  children.erase(it);
+  children->erase(child->name);
+  if (child->created) createdChildren--;
   child->parent = nullptr;
+  child->pathChanged();
+  updateReclaimable();
 }
 
 void Node::addChild(Node *child) {
   if (!child || this == child || fh == child->fh)
     throw NodeException("tree::Node: Wrong parameter");
 
-  auto it = children.find(child->name);
-  if (it != children.end()) {
-    if (it->second == child) {
+  loadChildren();
+  if (!children) children = std::make_unique<Children>();
+
+  Node *other = children->find(child->name);
+  if (other) {
+    if (other == child) {
       // nothing to do
       return;
     }
@@ -141,18 +243,21 @@ void Node::addChild(Node *child) {
 
   if (child->parent) child->parent->removeChild(child);
 
-  children.insert(std::pair<std::string, Node *>(child->name, child));
+  children->insert(child->name, child);
+  if (child->created) createdChildren++;
   child->parent = this;
+  child->pathChanged();
+  updateReclaimable();
 }
 
 void Node::deleteChild(Node *child) {
-  if (!child || !child->children.empty())
+  if (!child || child->hasChildren())
     throw NodeException("tree::Node: Wrong parameter or children not empty");
 
   removeChild(child);
 }
 
-void Node::setName(const std::string &name) {
+void Node::setName(const Name &name) {
   if (name.empty()) throw NodeException("tree::Node: Empty name not allowed");
 
   if (name == this->name) return;
@@ -162,18 +267,28 @@ void Node::setName(const std::string &name) {
         "tree::Node: Cannot rename an element if it is attached to a parent");
 
   this->name = name;
+  pathChanged();
 }
 
-std::string Node::calcPath() {
+const std::string &Node::calcPath() {
+  auto &cached = cachedPath(this);
+  if (cached.node == this) {
+    Node *node = this;
+    while (node && node->moved <= cached.computed) node = node->parent;
+    if (!node) return cached.path;
+  }
+
   char buffer[4096];
   char *pos = buffer + 4096;
   Node *node = this;
+  pathMisses++;
 
   do {
-    pos = pos - node->getName().size();
+    const std::string entry = node->getName().str();
+    pos = pos - entry.size();
     if (pos <= buffer) throw NodeException("tree::Node: Path too long");
 
-    memcpy(pos, node->getName().c_str(), node->getName().size());
+    memcpy(pos, entry.data(), entry.size());
     node = node->getParent();
 
     --pos;
@@ -181,44 +296,31 @@ std::string Node::calcPath() {
   } while (node);
 
   ++pos;
-  return std::string(pos, (size_t)(buffer + 4096 - pos));
+  cached.node = this;
+  cached.computed = pathClock;
+  cached.path.assign(pos, (size_t)(buffer + 4096 - pos));
+  return cached.path;
 }
 
-static size_t makePathHelper(Node *node, char *buffer, const int mode,
-                             Logger *logger) {
-  if (!node) return 0;
-
-  size_t pos = makePathHelper(node->getParent(), buffer, mode, logger);
-
-  if (pos) {
-    buffer[pos] = '/';
-    ++pos;
-  }
-
-  if (pos + node->getName().size() > 4096)
-    throw Node::NodeException("tree::Node: Path too long");
-
-  memcpy(buffer + pos, node->getName().c_str(), node->getName().size());
+uint64_t Node::pathsComputed() { return pathMisses; }
 
-  pos += node->getName().size();
+static void makePathHelper(Node *node, const int mode, Logger *logger) {
+  if (!node) return;
 
-  buffer[pos] = 0;
+  makePathHelper(node->getParent(), mode, logger);
 
-  if (!node->isCreated() && mkdir(buffer, mode) && errno != EEXIST)
+  if (!node->isCreated() &&
+      mkdirat(node->parentFd(), node->getName().str().c_str(), mode) &&
+      errno != EEXIST)
     logger->error("ERROR creating directory");
   else
     node->setCreated(true);
-
-  return pos;
 }
 
-std::string Node::makePath(const int mode) {
-  if (isCreated()) return calcPath();
-
-  char buffer[4096];
+const std::string &Node::makePath(const int mode) {
+  if (!isCreated()) makePathHelper(this, mode, logger);
 
-  size_t len = makePathHelper(this, buffer, mode, logger);
-  return std::string(buffer, len);
+  return calcPath();
 }
 
 }  // namespace tree
@@ -19,84 +19,208 @@
 #ifndef TREE_NODE_H_
 #define TREE_NODE_H_
 
+#include <fcntl.h>
+
 #include <cstdint>
 #include <cstdio>
 #include <ctime>
-#include <map>
+#include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
 #include "display/logger.hpp"
 #include "parser/file_handle.hpp"
+#include "parser/name.hpp"
+#include "tree/child_index.hpp"
 
 namespace tree {
 
+class FileHandleMap;
+
+/*
+ * number of nodes allocated at once by the node slab
+ */
+#define NODE_SLAB_CHUNK 4096
+
+/*
+ * number of paths kept by the path cache, must be a power of 2
+ */
+#define NODE_PATH_CACHE_SIZE 4096
+
+/*
+ * number of directory descriptors kept open by the nodes
+ */
+#define NODE_DIR_FD_CACHE_SIZE 256
+
+/*
+ * number of file descriptors kept open for writing
+ */
+#define NODE_FILE_FD_CACHE_SIZE 128
+
+/*
+ * Nodes are allocated from a slab without a malloc header per node.
+ * The children are only allocated for nodes that get a child, i.e. for
+ * directories. Names are interned, so the children are looked up by the
+ * identity of their names.
+ */
 class Node {
+ public:
+  using Name = parser::Name;
+  using Children = ChildIndex;
+
  private:
   using FileHandle = parser::FileHandle;
   static Logger *logger;
+  static const Children noChildren;
+  // the reclaimable nodes from the least to the most recently accessed
+  static Node *lruFirst;
+  static Node *lruLast;
+  // the map which loads the children of spilled nodes
+  static FileHandleMap *store;
   Node *parent;
-  std::string name;
+  // next node with the same handle, i.e. a hard link
+  Node *nextLink = nullptr;
+  Node *lruPrev = nullptr;
+  Node *lruNext = nullptr;
   FileHandle fh;
   uint64_t size;
-  bool created;
-  bool dir;
-  std::map<std::string, Node *> children;
   int64_t last_access;
+  std::unique_ptr<Children> children;
+  Name name;
+  // tick of the path clock when the node was last moved or renamed
+  uint64_t moved = 0;
+  // number of children with created set
+  uint32_t createdChildren = 0;
+  bool created : 1;
+  bool dir : 1;
+  // in the LRU list, i.e. neither created nor a parent
+  bool reclaimable : 1;
+  // the children are spilled to the disk
+  bool spilled : 1;
+
+  friend class FileHandleMap;
+
+  void lruLink() {
+    lruPrev = lruLast;
+    lruNext = nullptr;
+    (lruLast ? lruLast->lruNext : lruFirst) = this;
+    lruLast = this;
+  }
+
+  void lruUnlink() {
+    (lruPrev ? lruPrev->lruNext : lruFirst) = lruNext;
+    (lruNext ? lruNext->lruPrev : lruLast) = lruPrev;
+  }
+
+  void load();
+  void loadChildren() {
+    if (spilled) load();
+  }
+
+  void updateReclaimable() {
+    bool r = !created && !hasChildren();
+    if (r == reclaimable) return;
+
+    if (r)
+      lruLink();
+    else
+      lruUnlink();
+    reclaimable = r;
+  }
 
  public:
   static void setLogger(Logger *l) { logger = l; }
 
   Node(const FileHandle &fh, int64_t timestamp)
       : parent(nullptr),
-        name(fh),
         fh(fh),
         size(0),
+        last_access(timestamp),
+        name(Name::fromHandle(fh)),
         created(false),
         dir(false),
-        last_access(timestamp) {
+        reclaimable(true),
+        spilled(false) {
     if (name.empty()) throw NodeException("tree::Node: Empty name not allowed");
+    lruLink();
   }
 
-  Node(const FileHandle &fh, const std::string &name, int64_t timestamp)
+  Node(const FileHandle &fh, const Name &name, int64_t timestamp)
       : parent(nullptr),
-        name(name),
         fh(fh),
         size(0),
+        last_access(timestamp),
+        name(name),
         created(false),
         dir(false),
-        last_access(timestamp) {
+        reclaimable(true),
+        spilled(false) {
     if (fh.empty() || name.empty())
       throw NodeException("tree::Node: Empty name not allowed");
+    lruLink();
   }
 
-  void setLastAccess(int64_t timestamp) { last_access = timestamp; }
-  [[nodiscard]] int64_t getLastAccess() const { return last_access; }
+  ~Node() {
+    if (reclaimable) lruUnlink();
+  }
+
+  Node(const Node &) = delete;
+  Node &operator=(const Node &) = delete;
 
-  std::map<std::string, Node *>::iterator children_begin() {
-    return children.begin();
+  // moves the node to the end of the LRU list
+  void setLastAccess(int64_t timestamp) {
+    last_access = timestamp;
+    if (reclaimable && lruLast != this) {
+      lruUnlink();
+      lruLink();
+    }
   }
+  [[nodiscard]] int64_t getLastAccess() const { return last_access; }
+
+  /*
+   * The least recently accessed node, which is neither created nor has
+   * children. Such a node can be deleted without changing the disk.
+   */
+  static Node *leastRecentlyUsed() { return lruFirst; }
+
+  static void *operator new(size_t size);
+  static void operator delete(void *ptr);
+
+  // the paths of this node and of all nodes below it have changed
+  void pathChanged();
+  // the file or directory of this node is gone from the disk
+  void closeFds();
 
-  std::map<std::string, Node *>::iterator children_end() {
-    return children.end();
+  [[nodiscard]] const Children &getChildren() {
+    loadChildren();
+    return children ? *children : noChildren;
   }
 
   Node *getParent() { return parent; }
-  std::string &getName() { return name; }
+  const Name &getName() { return name; }
   FileHandle &getHandle() { return fh; }
   uint64_t getSize() { return size; }
   void setSize(uint64_t s) { size = s; }
 
   void clearChildren() {
-    for (auto &i : children) {
-      i.second->parent = nullptr;
+    loadChildren();
+    if (!children) return;
+
+    for (auto child : *children) {
+      child->parent = nullptr;
+      child->pathChanged();
     }
 
-    children.clear();
+    children.reset();
+    createdChildren = 0;
+    updateReclaimable();
   }
 
-  [[nodiscard]] bool hasChildren() const { return !children.empty(); }
-  [[nodiscard]] bool isDeletable() const { return children.empty(); }
+  [[nodiscard]] bool hasChildren() const {
+    return spilled || (children && !children->empty());
+  }
+  [[nodiscard]] bool isDeletable() const { return !hasChildren(); }
 
   void setHandle(const FileHandle &handle) {
     if (handle.empty()) throw NodeException("tree::Node: Empty fh not allowed");
@@ -114,21 +238,55 @@ class Node {
   }
 
   [[nodiscard]] bool isCreated() const { return created; }
-  void setCreated(bool created) { this->created = created; }
+  void setCreated(bool created) {
+    if (!created) closeFds();
+    if (parent && created != this->created)
+      parent->createdChildren += created ? 1 : -1;
+    this->created = created;
+    updateReclaimable();
+  }
   [[nodiscard]] bool isDir() const { return dir; }
   void setDir(bool dir) { this->dir = dir; }
 
-  void setName(const std::string &name);
+  void setName(const Name &name);
   void addChild(Node *child);
   void removeChild(Node *child);
   void deleteChild(Node *child);
-  [[nodiscard]] Node *getChild(const std::string &name) const;
+  [[nodiscard]] Node *getChild(const Name &name);
 
-  [[nodiscard]] bool isChildCreated() const;
+  [[nodiscard]] bool isChildCreated() const { return createdChildren != 0; }
   void writeToSize(uint64_t size);
   void clearEmptyDir();
-  std::string calcPath();
-  std::string makePath(int mode = 0755);
+  /*
+   * The paths are cached, the returned reference is valid until the
+   * next call of calcPath() or makePath().
+   */
+  const std::string &calcPath();
+  const std::string &makePath(int mode = 0755);
+  // number of paths that were not found in the cache
+  static uint64_t pathsComputed();
+
+  /*
+   * Descriptor of the directory of this node for the *at() functions or
+   * -1. The descriptors are cached and the last two returned ones stay
+   * open at least until the next call.
+   */
+  int dirFd();
+  int parentFd() { return parent ? parent->dirFd() : AT_FDCWD; }
+  // removes the file or directory of this node like remove(3)
+  int removeEntry();
+
+  /*
+   * Opens the file of this node for reading and writing like openat(2)
+   * with the given flags. The descriptor is cached and must not be
+   * closed, it stays open at least until the next call.
+   */
+  int openFile(int flags);
+  /*
+   * Sets the function called before the cache closes a descriptor of
+   * openFile(), e.g. to submit the operations queued for it.
+   */
+  static void setBeforeFileClose(std::function<void()> hook);
 
   class NodeException : public std::runtime_error {
     using std::runtime_error::runtime_error;
@@ -0,0 +1,78 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tree/node_store.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace tree {
+
+NodeStore::NodeStore(const std::string &dir) {
+  std::string path = dir + "/nfsreplay-spill-XXXXXX";
+
+  fd = mkostemp(&path[0], O_CLOEXEC);
+  if (fd == -1)
+    throw NodeStoreException(std::string("NodeStore: ") + strerror(errno));
+
+  // the file disappears with the process
+  unlink(path.c_str());
+}
+
+NodeStore::~NodeStore() { close(fd); }
+
+uint64_t NodeStore::append(const void *data, size_t len) {
+  uint64_t offset = end;
+  auto pos = static_cast<const char *>(data);
+
+  while (len > 0) {
+    ssize_t ret = pwrite(fd, pos, len, end);
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      throw NodeStoreException(std::string("NodeStore: ") + strerror(errno));
+    }
+
+    pos += ret;
+    len -= ret;
+    end += ret;
+  }
+
+  return offset;
+}
+
+void NodeStore::read(uint64_t offset, void *data, size_t len) const {
+  auto pos = static_cast<char *>(data);
+
+  while (len > 0) {
+    ssize_t ret = pread(fd, pos, len, offset);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret <= 0)
+      throw NodeStoreException("NodeStore: Unable to read spilled nodes");
+
+    pos += ret;
+    len -= ret;
+    offset += ret;
+  }
+}
+
+}  // namespace tree
@@ -0,0 +1,60 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TREE_NODE_STORE_H_
+#define TREE_NODE_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace tree {
+
+/*
+ * Append only log of spilled nodes in an unlinked temporary file. The
+ * records are only valid while the process runs, so they are written in
+ * the native format without any versioning.
+ */
+class NodeStore {
+ private:
+  int fd;
+  uint64_t end = 0;
+
+ public:
+  // creates the file in the given directory
+  explicit NodeStore(const std::string &dir);
+  ~NodeStore();
+
+  NodeStore(const NodeStore &) = delete;
+  NodeStore &operator=(const NodeStore &) = delete;
+
+  // returns the offset of the data in the file
+  uint64_t append(const void *data, size_t len);
+  void read(uint64_t offset, void *data, size_t len) const;
+
+  [[nodiscard]] uint64_t size() const { return end; }
+
+  class NodeStoreException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+};
+
+}  // namespace tree
+
+#endif /* TREE_NODE_STORE_H_ */
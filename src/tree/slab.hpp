@@ -0,0 +1,76 @@
+/*
+ * nfstrace-replay - Small command line tool to replay file system traces
+ * Copyright (C) 2014  Andreas Rohner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TREE_SLAB_H_
+#define TREE_SLAB_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace tree {
+
+/*
+ * Allocates objects of a single type from large chunks. Freed objects
+ * are kept in a free list and reused, the chunks are only released
+ * with the slab. There is no per object header, so an object takes
+ * exactly sizeof(T) bytes. The slab is not thread safe.
+ */
+template <typename T, size_t ChunkObjects>
+class Slab {
+ private:
+  union Item {
+    Item *next;
+    alignas(T) char storage[sizeof(T)];
+  };
+
+  std::vector<std::unique_ptr<Item[]>> chunks;
+  Item *freeList = nullptr;
+  // unused items at the end of the last chunk
+  size_t chunkPos = ChunkObjects;
+
+ public:
+  Slab() = default;
+  Slab(const Slab &) = delete;
+  Slab &operator=(const Slab &) = delete;
+
+  void *allocate() {
+    if (freeList) {
+      Item *item = freeList;
+      freeList = item->next;
+      return item->storage;
+    }
+
+    if (chunkPos == ChunkObjects) {
+      chunks.emplace_back(new Item[ChunkObjects]);
+      chunkPos = 0;
+    }
+
+    return chunks.back()[chunkPos++].storage;
+  }
+
+  void deallocate(void *ptr) {
+    Item *item = reinterpret_cast<Item *>(ptr);
+    item->next = freeList;
+    freeList = item;
+  }
+};
+
+}  // namespace tree
+
+#endif /* TREE_SLAB_H_ */
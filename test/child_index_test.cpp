@@ -0,0 +1,46 @@
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+
+#include "tree/child_index.hpp"
+
+namespace test {
+
+TEST_CASE("ChildIndex matches a map", "[childindex]") {
+  tree::ChildIndex index;
+  std::map<std::string, tree::Node *> reference;
+  std::mt19937 rng(42);
+
+  for (int step = 0; step < 100000; ++step) {
+    // the number of names sweeps across the switch between both modes
+    int range = step / 10000 % 2 ? 300 : 20;
+    std::string name = "f" + std::to_string(rng() % range);
+    parser::Name key(name);
+    auto node = reinterpret_cast<tree::Node *>(uintptr_t(rng() % 1000 + 1));
+
+    if (rng() % 2) {
+      if (!reference.count(name)) {
+        index.insert(key, node);
+        reference[name] = node;
+      }
+    } else {
+      REQUIRE(index.erase(key) == (reference.erase(name) == 1));
+    }
+
+    auto it = reference.find(name);
+    REQUIRE(index.find(key) == (it != reference.end() ? it->second : nullptr));
+    REQUIRE(index.size() == reference.size());
+  }
+
+  size_t count = 0;
+  for (auto node : index) {
+    REQUIRE(node != nullptr);
+    count++;
+  }
+  REQUIRE(count == reference.size());
+}
+
+}  // namespace test
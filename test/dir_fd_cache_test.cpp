@@ -0,0 +1,77 @@
+#include <catch2/catch.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <list>
+#include <random>
+#include <utility>
+
+#include "tree/dir_fd_cache.hpp"
+
+namespace test {
+
+static bool isOpen(int fd) { return fcntl(fd, F_GETFD) != -1; }
+
+TEST_CASE("DirFdCache evicts the least recently used", "[dirfdcache]") {
+  const size_t capacity = 8;
+  int base = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+  REQUIRE(base != -1);
+
+  // keys and descriptors, most recently used first
+  std::list<std::pair<long, int>> reference;
+  std::mt19937 rng(42);
+
+  {
+    tree::DirFdCache cache(capacity);
+
+    for (int step = 0; step < 20000; ++step) {
+      long key = rng() % 20;
+      auto it = std::find_if(reference.begin(), reference.end(),
+                             [key](auto &e) { return e.first == key; });
+      auto ptr = reinterpret_cast<const void *>(key * 64);
+
+      switch (rng() % 3) {
+        case 0:
+          if (it == reference.end()) {
+            REQUIRE(cache.find(ptr) == -1);
+          } else {
+            REQUIRE(cache.find(ptr) == it->second);
+            reference.splice(reference.begin(), reference, it);
+          }
+          break;
+        case 1:
+          if (it == reference.end()) {
+            int fd = dup(base);
+            cache.insert(ptr, fd);
+            reference.emplace_front(key, fd);
+
+            if (reference.size() > capacity) {
+              REQUIRE_FALSE(isOpen(reference.back().second));
+              reference.pop_back();
+            }
+          }
+          break;
+        default:
+          cache.erase(ptr);
+          if (it != reference.end()) {
+            REQUIRE_FALSE(isOpen(it->second));
+            reference.erase(it);
+          }
+          break;
+      }
+
+      REQUIRE(cache.size() == reference.size());
+    }
+
+    for (auto &e : reference) REQUIRE(isOpen(e.second));
+  }
+
+  // the destructor closes the rest
+  for (auto &e : reference) REQUIRE_FALSE(isOpen(e.second));
+
+  close(base);
+}
+
+}  // namespace test
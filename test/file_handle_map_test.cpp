@@ -0,0 +1,176 @@
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tree/file_handle_map.hpp"
+
+namespace test {
+
+static parser::FileHandle handle(int i) {
+  char hex[32];
+  snprintf(hex, sizeof(hex), "5ea1ed%08x", i);
+
+  parser::FileHandle fh;
+  fh = hex;
+  return fh;
+}
+
+struct Expected {
+  parser::FileHandle parent;
+  std::string name;
+  uint64_t size;
+  bool created;
+};
+
+TEST_CASE("FileHandleMap matches a multimap", "[filehandlemap]") {
+  tree::FileHandleMap fhmap;
+  std::multimap<int, tree::Node *> reference;
+  std::vector<std::pair<int, tree::Node *>> nodes;
+  std::mt19937 rng(42);
+
+  // drops the i-th node from the reference
+  auto erase = [&](size_t i) {
+    auto range = reference.equal_range(nodes[i].first);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == nodes[i].second) {
+        reference.erase(it);
+        break;
+      }
+    }
+    nodes[i] = nodes.back();
+    nodes.pop_back();
+  };
+
+  // the table starts small, so it grows a few times on the way
+  for (int step = 0; step < 200000; ++step) {
+    int h = rng() % 5000;
+    unsigned op = rng() % 10;
+
+    if (op < 4 || nodes.empty()) {
+      // hard links share the handle, the latest one is found first
+      auto node = fhmap.createNode(handle(h), 0);
+      reference.emplace(h, node);
+      nodes.emplace_back(h, node);
+      REQUIRE(fhmap.getNode(handle(h)) == node);
+    } else if (op < 7) {
+      size_t i = rng() % nodes.size();
+      auto node = nodes[i].second;
+      erase(i);
+      REQUIRE(fhmap.removeNode(node).get() == node);
+    } else {
+      size_t i = rng() % nodes.size();
+      auto node = nodes[i].second;
+      erase(i);
+      fhmap.switchNodeHandle(node, handle(h));
+      reference.emplace(h, node);
+      nodes.emplace_back(h, node);
+      REQUIRE(fhmap.getNode(handle(h)) == node);
+      REQUIRE(node->getHandle() == handle(h));
+    }
+
+    int q = rng() % 5000;
+    auto node = fhmap.getNode(handle(q));
+    auto range = reference.equal_range(q);
+    if (range.first == range.second) {
+      REQUIRE(node == nullptr);
+    } else {
+      bool found = false;
+      for (auto it = range.first; it != range.second; ++it)
+        found = found || it->second == node;
+      REQUIRE(found);
+    }
+    REQUIRE(fhmap.size() == reference.size());
+  }
+
+  std::map<tree::Node *, int> handles;
+  for (auto &e : nodes) handles[e.second] = e.first;
+
+  uint64_t n = 0;
+  fhmap.forEachNode([&](tree::Node *node) {
+    n++;
+    REQUIRE(handles.count(node));
+    REQUIRE(node->getHandle() == handle(handles[node]));
+  });
+  REQUIRE(n == reference.size());
+}
+
+TEST_CASE("FileHandleMap spills and loads subtrees", "[filehandlemap]") {
+  tree::FileHandleMap fhmap(16);
+  std::map<int, Expected> expected;
+  int next = 0;
+
+  auto add = [&](tree::Node *parent, const std::string &name, bool dir) {
+    int i = ++next;
+    auto node = fhmap.createNode(handle(i), tree::Node::Name(name), 0);
+    node->setDir(dir);
+    node->setSize(i);
+    parent->addChild(node);
+    if (i % 3 == 0) node->setCreated(true);
+    expected[i] = {parent->getHandle(), name, (uint64_t)i, i % 3 == 0};
+    return node;
+  };
+
+  auto root = fhmap.getOrCreateDir(handle(0), 1000);
+  std::vector<tree::Node *> dirs;
+  for (int d = 0; d < 4; ++d) {
+    auto dir = add(root, "dir" + std::to_string(d), true);
+    dirs.push_back(dir);
+    for (int f = 0; f < 20; ++f) add(dir, "f" + std::to_string(f), false);
+  }
+  auto sub = add(dirs[0], "sub", true)->getHandle();
+  for (int f = 0; f < 5; ++f)
+    add(fhmap.getNode(sub), "g" + std::to_string(f), false);
+
+  root->setLastAccess(1000);
+  dirs[0]->setLastAccess(1000);
+  const uint64_t total = fhmap.size();
+
+  fhmap.enableSpill("/tmp");
+
+  auto spillAll = [&](const tree::FileHandleMap::Busy &busy = nullptr) {
+    uint64_t n = 0;
+    for (int i = 0; i < 100; ++i) n += fhmap.spillCold(100, busy);
+    return n;
+  };
+
+  // a busy node keeps its directory in memory
+  const tree::Node *busy = dirs[2]->getChild(tree::Node::Name("f3"));
+  REQUIRE(spillAll([&](const tree::Node *n) { return n == busy; }) ==
+          5 + 2 * 20);
+  REQUIRE(dirs[2]->getChild(tree::Node::Name("f3")) == busy);
+
+  // only the cold subtrees below the hot directories are spilled
+  uint64_t n = 5 + 2 * 20 + spillAll();
+  REQUIRE(n == 5 + 3 * 20);
+  REQUIRE(fhmap.size() == total - n);
+  REQUIRE(fhmap.spilled() == n);
+  REQUIRE(dirs[0]->getChild(tree::Node::Name("f0")));
+  REQUIRE(dirs[1]->isChildCreated());
+  REQUIRE_FALSE(dirs[1]->isDeletable());
+
+  // the stub of sub ends up in the record of dir0
+  dirs[0]->setLastAccess(0);
+  REQUIRE(spillAll() == 21);
+  REQUIRE(fhmap.size() == 5);
+
+  for (auto &e : expected) {
+    auto node = fhmap.getNode(handle(e.first));
+    REQUIRE(node);
+    REQUIRE(node->getParent()->getHandle() == e.second.parent);
+    REQUIRE(node->getName() == e.second.name);
+    REQUIRE(node->getSize() == e.second.size);
+    REQUIRE(node->isCreated() == e.second.created);
+  }
+
+  REQUIRE(fhmap.size() == total);
+  REQUIRE(fhmap.spilled() == 0);
+  REQUIRE(fhmap.loaded() == 5 + 3 * 20 + 21);
+  REQUIRE(fhmap.getNode(sub)->getChildren().size() == 5);
+}
+
+}  // namespace test
@@ -0,0 +1,68 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+
+#include "parser/file_handle.hpp"
+#include "parser/name.hpp"
+
+namespace test {
+
+TEST_CASE("FileHandle compares the full handle", "[filehandle]") {
+  parser::FileHandle a, b, c, d;
+
+  // both sum up to the same 64 bit value under the old scheme
+  a = "00000000000000010000000000000002";
+  b = "00000000000000020000000000000001";
+  c = "00000000000000010000000000000002";
+  d = "00000000000000010000000000000002ABCDEF";
+
+  REQUIRE(a != b);
+  REQUIRE(a == c);
+  REQUIRE(a != d);
+  REQUIRE(std::hash<parser::FileHandle>()(a) ==
+          std::hash<parser::FileHandle>()(c));
+  REQUIRE(parser::FileHandle::legacyCollisions() >= 1);
+
+  // upper and lower case hex digits decode to the same handle
+  b = "00000000000000010000000000000002abcdef";
+  REQUIRE(b == d);
+  REQUIRE(std::string(d) == "00000000000000010000000000000002abcdef");
+
+  // tokens that are not hex are kept as they are
+  b = "0000000000000001000000000000000g";
+  REQUIRE(b != a);
+  REQUIRE(std::string(b) == "0000000000000001000000000000000g");
+  b = "123";
+  REQUIRE(std::string(b) == "123");
+
+  REQUIRE(parser::FileHandle::fromKey(a.key()) == a);
+
+  a = "";
+  REQUIRE(a.empty());
+}
+
+TEST_CASE("Names of handles stay out of the name pool", "[filehandle]") {
+  parser::FileHandle a, b;
+  a = "00000000000000010000000000000003";
+  b = "00000000000000010000000000000004";
+
+  uint64_t count = parser::Name::count();
+  auto name = parser::Name::fromHandle(a);
+  REQUIRE(parser::Name::count() == count);
+
+  REQUIRE(name.isHandle());
+  REQUIRE_FALSE(name.empty());
+  REQUIRE(name.str() == "00000000000000010000000000000003");
+  REQUIRE(name == parser::Name::fromHandle(a));
+  REQUIRE(name != parser::Name::fromHandle(b));
+  REQUIRE(name.hash() == a.hash());
+
+  // a file may be called like a handle
+  parser::Name text("00000000000000010000000000000003");
+  REQUIRE_FALSE(text.isHandle());
+  REQUIRE(text != name);
+
+  REQUIRE(parser::Name::fromHandle(parser::FileHandle()).empty());
+}
+
+}  // namespace test
@@ -0,0 +1,308 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parser/convert.hpp"
+#include "parser/frame.hpp"
+#include "parser/parser.hpp"
+#include "parser/tokenizer.hpp"
+
+namespace test {
+
+// the attributes as Frame::setAttribute set them before the perfect hash
+struct ReferenceFrame {
+  int64_t time = 0;
+  uint32_t xid = 0;
+  uint32_t client = 0;
+  parser::Protocol protocol = parser::NOPROT;
+  parser::OpId operation = parser::NULLOP;
+  parser::Status status = parser::FSENT;
+  bool truncated = false;
+  bool size_occured = false;
+  uint32_t count = 0;
+  uint32_t mode = 0;
+  uint64_t size = 0;
+  uint64_t offset = 0;
+  int64_t atime = 0;
+  int64_t mtime = 0;
+  parser::FileHandle fh;
+  parser::FileHandle fh2;
+  parser::Name name;
+  parser::Name name2;
+  parser::FType ftype = parser::NOFILE;
+
+  void setAttribute(std::string_view name, std::string_view token) {
+    using namespace parser;
+
+    if (!count && (name == "count" || name == "tcount")) {
+      count = parseHex(token);
+    } else if (this->name.empty() && (name == "name" || name == "fn")) {
+      this->name = token;
+    } else if (!size_occured && name == "size") {
+      size_occured = true;
+      size = parseHex(token);
+    } else if (ftype == NOFILE && name == "ftype") {
+      ftype = (FType)parseDec(token);
+    } else if (token == "LONGPKT") {
+      truncated = true;
+    } else if (!offset && (name == "off" || name == "offset")) {
+      offset = parseHex(token);
+    } else if (fh.empty() && name == "fh") {
+      fh = token;
+    } else if (fh2.empty() && name == "fh2") {
+      fh2 = token;
+    } else if (name2.empty() &&
+               (name == "fn2" || name == "name2" || name == "sdata")) {
+      name2 = token;
+    } else if (!mode && name == "mode") {
+      mode = 0x1FF & parseHex(token);
+    } else if (!atime && name == "atime") {
+      atime = parseDec(token);
+    } else if (!mtime && name == "mtime") {
+      mtime = parseDec(token);
+    }
+  }
+};
+
+// the lookup of the operation names Parser used before
+static parser::OpId referenceOpId(std::string_view op) {
+  using namespace parser;
+  static const std::map<std::string, OpId> ops{
+      {"null", NULLOP},         {"getattr", GETATTR},
+      {"setattr", SETATTR},     {"lookup", LOOKUP},
+      {"access", ACCESS},       {"read", READ},
+      {"readlink", READLINK},   {"write", WRITE},
+      {"create", CREATE},       {"mkdir", MKDIR},
+      {"symlink", SYMLINK},     {"mknod", MKNOD},
+      {"remove", REMOVE},       {"rmdir", RMDIR},
+      {"rename", RENAME},       {"link", LINK},
+      {"readdir", READDIR},     {"readdirp", READDIRPLUS},
+      {"readdirplus", READDIRPLUS}, {"fsstat", FSSTAT},
+      {"fsinfo", FSINFO},       {"pathconf", PATHCONF},
+      {"commit", COMMIT}};
+
+  if (op.size() >= 16) return NULLOP;
+
+  std::string lower;
+  for (char c : op) lower.push_back(tolower(c));
+
+  auto it = ops.find(lower);
+  return it != ops.end() ? it->second : NULLOP;
+}
+
+static uint32_t referenceClientId(std::string_view token) {
+  size_t len;
+  uint32_t first = parser::parseHex(token, &len);
+  uint32_t second =
+      parser::parseHex(token.substr(std::min(len + 1, token.size())));
+  return (first << 16) | second;
+}
+
+/*
+ * Parser::parse before the attributes were decoded lazily. It splits the
+ * lines with the scalar classifier, while Parser uses the vectorized one.
+ */
+static bool referenceParse(std::string_view line, ReferenceFrame &ref) {
+  using namespace parser;
+  static Tokenizer tokenizer(classifyScalar);
+  std::string_view src;
+  std::string_view dest;
+  std::string_view last;
+
+  if (line.empty() || !isdigit(line[0])) return false;
+
+  auto &tokens = tokenizer.tokenize(line);
+  for (size_t count = 0; count < tokens.size(); ++count) {
+    std::string_view token = tokens[count];
+    bool response = ref.protocol == R2 || ref.protocol == R3;
+
+    switch (count) {
+      case 0:
+        ref.time = parseDec(token);
+        break;
+      case 1:
+        src = token;
+        break;
+      case 2:
+        dest = token;
+        break;
+      case 4:
+        if (!token.empty() && token[0] == 'R') {
+          ref.protocol = token.size() > 1 && token[1] == '2' ? R2 : R3;
+          ref.client = referenceClientId(dest);
+        } else if (!token.empty() && token[0] == 'C') {
+          ref.protocol = token.size() > 1 && token[1] == '2' ? C2 : C3;
+          ref.client = referenceClientId(src);
+        }
+        break;
+      case 5:
+        ref.xid = parseHex(token);
+        break;
+      case 7:
+        ref.operation = referenceOpId(token);
+        break;
+      case 8:
+        if (response) ref.status = token == "OK" ? FOK : FERROR;
+        break;
+    }
+
+    if (count > 8 || (count == 8 && response)) ref.setAttribute(last, token);
+    last = token;
+  }
+
+  return ref.protocol != NOPROT;
+}
+
+static void requireSameAttributes(const parser::Frame &frame,
+                                  const ReferenceFrame &ref) {
+  REQUIRE(frame.truncated == ref.truncated);
+  REQUIRE(frame.count == ref.count);
+  REQUIRE(frame.mode == ref.mode);
+  REQUIRE(frame.size == ref.size);
+  REQUIRE(frame.offset == ref.offset);
+  REQUIRE(frame.atime == ref.atime);
+  REQUIRE(frame.mtime == ref.mtime);
+  REQUIRE(frame.fh == ref.fh);
+  REQUIRE(frame.fh2 == ref.fh2);
+  REQUIRE(frame.name == ref.name);
+  REQUIRE(frame.name2 == ref.name2);
+  REQUIRE(frame.ftype == ref.ftype);
+}
+
+// keys of the traces, near misses and other words in random case
+static std::string randomKey(std::mt19937 &rng) {
+  static const char *const keys[] = {
+      "count",   "tcount",  "name",        "fn",
+      "size",    "ftype",   "off",         "offset",
+      "fh",      "fh2",     "fn2",         "name2",
+      "sdata",   "mode",    "atime",       "mtime",
+      "fh3",     "offs",    "nam",         "",
+      "LONGPKT", "read",    "write",       "readdirp",
+      "getattr", "commit",  "readdirplus", "pathconfx",
+      "null",    "readdirplusreaddirplus"};
+  std::string key = keys[rng() % (sizeof(keys) / sizeof(keys[0]))];
+
+  if (rng() % 8 == 0)
+    for (auto &c : key) c = rng() % 2 ? toupper(c) : c;
+
+  return key;
+}
+
+static std::string randomValue(std::mt19937 &rng) {
+  static const char *const values[] = {
+      "0",   "1",     "1a",   "ff",      "-3",  "12",
+      "",    "a",     "a b",  "LONGPKT", "x.y", "fffffff",
+      "1e5", "2000",  "8",    "1ff",     "fh",  "count",
+      "6a0f23ad6e4a0a000a0000000e1b0e00",
+      "00000000000000010000000000000002"};
+  return values[rng() % (sizeof(values) / sizeof(values[0]))];
+}
+
+// a trace line with random fields, quotes, stray tokens and cut offs
+static std::string randomLine(std::mt19937 &rng) {
+  static const char *const protocols[] = {"C3", "R3", "C2", "R2",
+                                          "C",  "R",  "X",  ""};
+  std::vector<std::string> fields{
+      std::to_string(1003708800 + rng() % 1000) + "." +
+          std::to_string(rng() % 1000000),
+      std::to_string(rng() % 100) + ".03fe",
+      std::to_string(rng() % 100) + ".0801",
+      "U",
+      protocols[rng() % 8],
+      std::to_string(rng() % 100000),
+      "6",
+      randomKey(rng)};
+
+  if (fields[4][0] == 'R') fields.push_back(rng() % 4 ? "OK" : "5");
+
+  for (unsigned n = rng() % 8; n; --n) {
+    fields.push_back(randomKey(rng));
+    fields.push_back(randomValue(rng));
+    if (rng() % 10 == 0) fields.push_back(randomValue(rng));
+  }
+  if (rng() % 4 == 0) {
+    for (auto f : {"con", "=", "XXX", "len", "=", "XXX"}) fields.push_back(f);
+  }
+
+  // values with spaces are quoted, a few fields are separated by two
+  std::string line;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (i) line += rng() % 50 ? " " : "  ";
+    if (fields[i].find(' ') != std::string::npos)
+      line += "\"" + fields[i] + "\"";
+    else
+      line += fields[i];
+  }
+
+  if (rng() % 20 == 0) line.resize(rng() % (line.size() + 1));
+  if (rng() % 50 == 0) line = "# " + line;
+  return line;
+}
+
+TEST_CASE("Frame sets the attributes like the reference", "[frame]") {
+  std::mt19937 rng(42);
+
+  for (int i = 0; i < 200000; ++i) {
+    parser::Frame frame;
+    ReferenceFrame ref;
+
+    // the first value wins, unless LONGPKT comes first
+    for (unsigned n = rng() % 9; n; --n) {
+      std::string key = randomKey(rng);
+      std::string value = randomValue(rng);
+      frame.setAttribute(key, value);
+      ref.setAttribute(key, value);
+    }
+    requireSameAttributes(frame, ref);
+
+    std::string op = randomKey(rng);
+    INFO("operation: " << op);
+    REQUIRE(parser::opIds.find(op) == referenceOpId(op));
+  }
+}
+
+TEST_CASE("Frame decodes lazily like the eager parser", "[frame]") {
+  std::mt19937 rng(42);
+  parser::Parser parser(true);
+  parser::Parser replay;
+
+  for (int i = 0; i < 200000; ++i) {
+    std::string line = randomLine(rng);
+    ReferenceFrame ref;
+    INFO("line: \"" << line << "\"");
+
+    auto frame = parser.parse(line);
+    if (!referenceParse(line, ref)) {
+      REQUIRE_FALSE(frame);
+      continue;
+    }
+
+    REQUIRE(frame);
+    REQUIRE(frame->time == ref.time);
+    REQUIRE(frame->xid == ref.xid);
+    REQUIRE(frame->client == ref.client);
+    REQUIRE(frame->protocol == ref.protocol);
+    REQUIRE(frame->operation == ref.operation);
+    REQUIRE(frame->status == ref.status);
+
+    // the replay does not even copy the attributes it never looks at
+    auto kept = replay.parse(line);
+    REQUIRE(kept);
+    if (parser::isReplayed(ref.operation))
+      REQUIRE(kept->raw == frame->raw);
+    else
+      REQUIRE(kept->raw.empty());
+
+    frame->decode();
+    requireSameAttributes(*frame, ref);
+  }
+}
+
+}  // namespace test
@@ -0,0 +1,119 @@
+#include <catch2/catch.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "replay/io_ring.hpp"
+
+namespace test {
+
+// the nodes without parent are relative to the working directory
+struct RingDir {
+  char dir[32] = "/tmp/io_ring_test_XXXXXX";
+  int cwd = -1;
+
+  RingDir() {
+    REQUIRE(mkdtemp(dir));
+    cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    REQUIRE(cwd != -1);
+    REQUIRE(chdir(dir) == 0);
+  }
+
+  ~RingDir() {
+    REQUIRE(fchdir(cwd) == 0);
+    close(cwd);
+    REQUIRE(rmdir(dir) == 0);
+  }
+};
+
+TEST_CASE("IoRing writes files", "[ioring]") {
+  Logger logger;
+  std::vector<char> data(4096, 'x');
+  std::unique_ptr<replay::IoRing> ring;
+
+  try {
+    ring = std::make_unique<replay::IoRing>(4, data.data(), data.size(),
+                                            logger);
+  } catch (replay::IoRing::IoRingException &e) {
+    WARN("io_uring is not available: " << e.what());
+    return;
+  }
+
+  RingDir dir;
+  parser::FileHandle fh;
+  fh = "10a1f11e";
+  std::vector<std::unique_ptr<tree::Node>> nodes;
+  for (int i = 0; i < 3; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "file%d", i);
+    nodes.emplace_back(new tree::Node(fh, tree::Node::Name(name), 0));
+    close(open(name, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR));
+  }
+
+  // more chunks than operations in flight and writes with holes
+  for (int i = 0; i < 3; ++i) {
+    ring->write(nodes[i].get(), 0, 10000, false);
+    ring->write(nodes[i].get(), 20000 + i, 5000, i == 1);
+    ring->statx(nodes[i].get());
+  }
+  REQUIRE(ring->size() <= 4);
+
+  ring->wait(nodes[0].get());
+  ring->drain();
+  REQUIRE(ring->size() == 0);
+
+  for (int i = 0; i < 3; ++i) {
+    struct stat buf;
+    REQUIRE(stat(nodes[i]->calcPath().c_str(), &buf) == 0);
+    REQUIRE(buf.st_size == 25000 + i);
+
+    // the file starts with the written data and has a hole after it
+    int fd = open(nodes[i]->calcPath().c_str(), O_RDONLY);
+    char c[2];
+    REQUIRE(pread(fd, c, 2, 9999) == 2);
+    REQUIRE(c[0] == 'x');
+    REQUIRE(c[1] == 0);
+    close(fd);
+
+    REQUIRE(nodes[i]->removeEntry() == 0);
+  }
+}
+
+TEST_CASE("IoRing submits before a descriptor is closed", "[ioring]") {
+  Logger logger;
+  std::vector<char> data(4096, 'x');
+  std::unique_ptr<replay::IoRing> ring;
+
+  try {
+    ring = std::make_unique<replay::IoRing>(4, data.data(), data.size(),
+                                            logger);
+  } catch (replay::IoRing::IoRingException &e) {
+    WARN("io_uring is not available: " << e.what());
+    return;
+  }
+
+  RingDir dir;
+  parser::FileHandle fh;
+  fh = "10a1f11e";
+  std::unique_ptr<tree::Node> node(
+      new tree::Node(fh, tree::Node::Name("file"), 0));
+  close(open("file", O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR));
+
+  // the queued entries refer to the descriptor the cache closes
+  ring->write(node.get(), 0, 10000, true);
+  node->closeFds();
+  ring->drain();
+
+  struct stat buf;
+  REQUIRE(stat("file", &buf) == 0);
+  REQUIRE(buf.st_size == 10000);
+  REQUIRE(node->removeEntry() == 0);
+}
+
+}  // namespace test
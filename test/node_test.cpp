@@ -0,0 +1,174 @@
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <string>
+
+#include "tree/file_handle_map.hpp"
+#include "tree/node.hpp"
+
+namespace test {
+
+static parser::FileHandle nodeHandle(int i) {
+  char hex[32];
+  snprintf(hex, sizeof(hex), "0dde%08x", i);
+
+  parser::FileHandle fh;
+  fh = hex;
+  return fh;
+}
+
+TEST_CASE("Node recomputes the cached paths", "[node]") {
+  tree::FileHandleMap fhmap;
+  int next = 0;
+
+  auto add = [&](tree::Node *parent, const char *name) {
+    auto node = fhmap.createNode(nodeHandle(++next), tree::Node::Name(name), 0);
+    if (parent) parent->addChild(node);
+    return node;
+  };
+
+  auto root = add(nullptr, "root");
+  auto a = add(root, "a");
+  auto b = add(root, "b");
+  auto f = add(a, "f");
+  auto g = add(a, "g");
+
+  REQUIRE(a->calcPath() == "root/a");
+  REQUIRE(f->calcPath() == "root/a/f");
+  REQUIRE(g->calcPath() == "root/a/g");
+
+  // moving a directory changes the paths below it
+  b->addChild(a);
+  REQUIRE(a->calcPath() == "root/b/a");
+  REQUIRE(f->calcPath() == "root/b/a/f");
+  REQUIRE(g->calcPath() == "root/b/a/g");
+
+  // renaming a leaf only changes its own path
+  a->removeChild(f);
+  f->setName(tree::Node::Name("h"));
+  a->addChild(f);
+  REQUIRE(f->calcPath() == "root/b/a/h");
+  REQUIRE(g->calcPath() == "root/b/a/g");
+
+  b->removeChild(a);
+  a->setName(tree::Node::Name("c"));
+  b->addChild(a);
+  REQUIRE(f->calcPath() == "root/b/c/h");
+  REQUIRE(g->calcPath() == "root/b/c/g");
+
+  // the slab hands out the memory of the freed node again
+  tree::Node *freed = g;
+  a->removeChild(g);
+  fhmap.removeNode(g);
+  auto x = add(b, "x");
+  REQUIRE(x == freed);
+  REQUIRE(x->calcPath() == "root/b/x");
+
+  // a node without a name is called like its handle
+  auto orphan = fhmap.createNode(nodeHandle(++next), 0);
+  b->addChild(orphan);
+  REQUIRE(orphan->calcPath() ==
+          "root/b/" + std::string(orphan->getHandle()));
+}
+
+TEST_CASE("Node keeps the cached paths outside of a moved directory",
+          "[node]") {
+  tree::FileHandleMap fhmap;
+  int next = 0;
+
+  auto add = [&](tree::Node *parent, const char *name) {
+    auto node = fhmap.createNode(nodeHandle(++next), tree::Node::Name(name), 0);
+    if (parent) parent->addChild(node);
+    return node;
+  };
+
+  auto root = add(nullptr, "root");
+  auto a = add(root, "a");
+  auto b = add(root, "b");
+  auto f = add(a, "f");
+  auto h = add(b, "h");
+
+  REQUIRE(f->calcPath() == "root/a/f");
+  REQUIRE(h->calcPath() == "root/b/h");
+  auto computed = tree::Node::pathsComputed();
+
+  root->removeChild(a);
+  a->setName(tree::Node::Name("c"));
+  root->addChild(a);
+  REQUIRE(h->calcPath() == "root/b/h");
+  REQUIRE(tree::Node::pathsComputed() == computed);
+  REQUIRE(f->calcPath() == "root/c/f");
+  REQUIRE(tree::Node::pathsComputed() == computed + 1);
+
+  b->addChild(a);
+  REQUIRE(h->calcPath() == "root/b/h");
+  REQUIRE(f->calcPath() == "root/b/c/f");
+  REQUIRE(tree::Node::pathsComputed() == computed + 2);
+}
+
+TEST_CASE("Node reclaims the leaves in LRU order", "[node]") {
+  tree::FileHandleMap fhmap;
+  int next = 0;
+
+  auto add = [&](tree::Node *parent, const char *name, int64_t time) {
+    auto node =
+        fhmap.createNode(nodeHandle(++next), tree::Node::Name(name), time);
+    if (parent) parent->addChild(node);
+    return node;
+  };
+
+  // the steps of Engine::gc without the batch limit
+  auto gc = [&](int64_t before) {
+    unsigned n = 0;
+    for (auto node = tree::Node::leastRecentlyUsed();
+         node && node->getLastAccess() < before;
+         node = tree::Node::leastRecentlyUsed()) {
+      if (node->getParent()) node->getParent()->removeChild(node);
+      fhmap.removeNode(node);
+      n++;
+    }
+    return n;
+  };
+
+  auto root = add(nullptr, "root", 0);
+  auto a = add(root, "a", 1);
+  auto f = add(a, "f", 2);
+  auto g = add(a, "g", 3);
+  auto h = add(root, "h", 4);
+
+  // parents are not in the list
+  REQUIRE(tree::Node::leastRecentlyUsed() == f);
+
+  f->setLastAccess(10);
+  REQUIRE(tree::Node::leastRecentlyUsed() == g);
+
+  // created nodes leave the list and come back at its end
+  g->setCreated(true);
+  REQUIRE(tree::Node::leastRecentlyUsed() == h);
+  g->setCreated(false);
+  h->setCreated(true);
+  REQUIRE(tree::Node::leastRecentlyUsed() == f);
+
+  // the created leaves keep their parents
+  f->setCreated(true);
+  REQUIRE(gc(100) == 1);
+  REQUIRE(fhmap.size() == 4);
+  REQUIRE(fhmap.getNode(g->getHandle()) == nullptr);
+  REQUIRE(tree::Node::leastRecentlyUsed() == nullptr);
+
+  f->setCreated(false);
+  REQUIRE(gc(5) == 0);
+
+  // a becomes a leaf once f is gone, root stays because of h
+  REQUIRE(gc(100) == 2);
+  REQUIRE(fhmap.size() == 2);
+  REQUIRE(root->getChild(tree::Node::Name("a")) == nullptr);
+  REQUIRE(tree::Node::leastRecentlyUsed() == nullptr);
+
+  h->setCreated(false);
+  REQUIRE(gc(100) == 2);
+  REQUIRE(fhmap.size() == 0);
+  REQUIRE(tree::Node::leastRecentlyUsed() == nullptr);
+}
+
+}  // namespace test
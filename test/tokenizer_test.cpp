@@ -0,0 +1,136 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parser/tokenizer.hpp"
+
+namespace test {
+
+// the character by character loop Parser::parse used before
+static void referenceTokenize(std::string_view line,
+                              std::vector<std::string_view> &tokens) {
+  const char *pos = line.data();
+  const char *end = line.data() + line.size();
+  const char *start = pos;
+  bool eol = false;
+
+  tokens.clear();
+  while (!eol) {
+    if (pos != end && *pos == '"') {
+      pos++;
+      start++;
+      while (pos != end && *pos != '"') pos++;
+    } else {
+      while (pos != end && *pos != ' ') pos++;
+    }
+
+    if (pos == end) eol = true;
+
+    tokens.emplace_back(start, pos - start);
+    pos++;
+    start = pos;
+  }
+}
+
+static std::vector<parser::Classifier> classifiers() {
+  std::vector<parser::Classifier> result{parser::classifyScalar};
+#ifdef TOKENIZER_X86
+  result.push_back(parser::classifySse2);
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) result.push_back(parser::classifyAvx2);
+#endif
+  return result;
+}
+
+static const char *const sampleLine =
+    "1003708800.002146 31.03fe 30.0801 U C3 9c2e35f3 6 read fh "
+    "6a0f23ad6e4a0a000a0000000e1b0e00a8fcd6e70e000000cc1d0d00bbe5d367 "
+    "off 3e000 count 2000 \"con\" = XXX len = XXX";
+
+TEST_CASE("Tokenizer matches the reference field numbering", "[tokenizer]") {
+  std::vector<std::string> lines{
+      "",
+      " ",
+      "a",
+      "a b",
+      "a  b ",
+      "\"",
+      "\"\"",
+      "\"a b\" c",
+      "a \"b c\" d",
+      "a \"unterminated quote",
+      "x\"y z\" w",
+      sampleLine,
+      std::string(sampleLine) + " name \"a file name with spaces.txt\" x",
+  };
+
+  // random lines over a small alphabet hit all corner cases
+  std::mt19937 rng(42);
+  const char alphabet[] = "ab \"";
+  for (int i = 0; i < 2000; ++i) {
+    std::string line(rng() % 300, ' ');
+    for (auto &c : line) c = alphabet[rng() % 4];
+    lines.push_back(line);
+  }
+
+  std::vector<std::string_view> expected;
+
+  for (auto classify : classifiers()) {
+    parser::Tokenizer tokenizer(classify);
+
+    for (auto &line : lines) {
+      // an exactly sized copy, so reads past the line show up in ASan
+      std::unique_ptr<char[]> buf(new char[line.size()]);
+      memcpy(buf.get(), line.data(), line.size());
+      std::string_view view(buf.get(), line.size());
+
+      referenceTokenize(view, expected);
+      INFO("line: \"" << line << "\"");
+      REQUIRE(tokenizer.tokenize(view) == expected);
+
+      // a limited tokenization returns a prefix
+      size_t limit = line.size() % 10;
+      if (limit < expected.size()) expected.resize(limit);
+      REQUIRE(tokenizer.tokenize(view, limit) == expected);
+    }
+  }
+}
+
+TEST_CASE("Tokenizer microbenchmark", "[.][benchmark]") {
+  const int iterations = 200000;
+  std::string_view line(sampleLine);
+  std::vector<std::string_view> tokens;
+  size_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    referenceTokenize(line, tokens);
+    sink += tokens.size();
+  }
+  auto reference = std::chrono::steady_clock::now() - start;
+
+  for (auto classify : classifiers()) {
+    parser::Tokenizer tokenizer(classify);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+      sink += tokenizer.tokenize(line).size();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double ref = std::chrono::duration<double>(reference).count();
+    double simd = std::chrono::duration<double>(elapsed).count();
+
+    WARN("reference " << ref * 1e9 / iterations << " ns/line, tokenizer "
+                      << simd * 1e9 / iterations << " ns/line");
+  }
+
+  REQUIRE(sink > 0);
+}
+
+}  // namespace test
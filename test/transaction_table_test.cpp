@@ -0,0 +1,111 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <utility>
+
+#include "parser/frame_pool.hpp"
+#include "replay/transaction_table.hpp"
+
+namespace test {
+
+static parser::ConstFramePtr makeRequest(uint32_t client, uint32_t xid,
+                                         int64_t time) {
+  auto frame = parser::allocFrame();
+  frame->client = client;
+  frame->xid = xid;
+  frame->time = time;
+  return frame;
+}
+
+TEST_CASE("TransactionTable matches a map", "[transactiontable]") {
+  const int64_t maxAge = 1000;
+  replay::TransactionTable table(maxAge);
+  std::map<std::pair<uint32_t, uint32_t>, int64_t> reference;
+  std::mt19937 rng(42);
+  int64_t now = 0;
+
+  for (int step = 0; step < 200000; ++step) {
+    // several requests per second and a gap in the trace
+    now += step == 100000 ? 5000 : rng() % 2;
+
+    table.expire(now);
+    for (auto it = reference.begin(); it != reference.end();) {
+      if (it->second < now - maxAge)
+        it = reference.erase(it);
+      else
+        ++it;
+    }
+
+    // few clients and xids, so keys are replaced and probe runs are long
+    uint32_t client = rng() % 4;
+    uint32_t xid = rng() % 50000;
+
+    if (rng() % 3) {
+      // some requests are slightly out of order
+      int64_t time = now - rng() % 3;
+      table.insert(makeRequest(client, xid, time));
+      reference[{client, xid}] = time;
+    } else {
+      auto req = table.take(client, xid);
+      auto it = reference.find({client, xid});
+
+      REQUIRE(bool(req) == (it != reference.end()));
+      if (req) {
+        REQUIRE(req->time == it->second);
+        reference.erase(it);
+      }
+    }
+
+    REQUIRE(table.size() == reference.size());
+  }
+
+  for (auto &entry : reference) {
+    auto req = table.take(entry.first.first, entry.first.second);
+    REQUIRE(req);
+    REQUIRE(req->time == entry.second);
+  }
+  REQUIRE(table.size() == 0);
+}
+
+TEST_CASE("TransactionTable microbenchmark", "[.][benchmark]") {
+  const uint32_t pending = 1000000;
+  const uint32_t iterations = 4000000;
+  std::unordered_map<uint32_t, parser::ConstFramePtr> map;
+  replay::TransactionTable table(300);
+  size_t sink = 0;
+
+  for (uint32_t i = 0; i < pending; ++i) {
+    map[i * 7919] = makeRequest(0, i * 7919, 0);
+    table.insert(makeRequest(0, i * 7919, 0));
+  }
+
+  // every response completes the oldest request and a new one arrives
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    auto it = map.find(i * 7919);
+    sink += it != map.end();
+    map.erase(it);
+    map[(i + pending) * 7919] = makeRequest(0, (i + pending) * 7919, 0);
+  }
+  auto reference = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    sink += bool(table.take(0, i * 7919));
+    table.insert(makeRequest(0, (i + pending) * 7919, 0));
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  double ref = std::chrono::duration<double>(reference).count();
+  double flat = std::chrono::duration<double>(elapsed).count();
+
+  WARN("unordered_map " << ref * 1e9 / iterations << " ns/match, table "
+                        << flat * 1e9 / iterations << " ns/match");
+  REQUIRE(sink == 2 * iterations);
+}
+
+}  // namespace test
@@ -0,0 +1,122 @@
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <set>
+#include <vector>
+
+#include "replay/write_coalescer.hpp"
+
+namespace test {
+
+using Run = replay::WriteCoalescer::Run;
+
+// the runs are only compared, never dereferenced
+static tree::Node *node(long i) {
+  return reinterpret_cast<tree::Node *>(i * 64);
+}
+
+TEST_CASE("WriteCoalescer merges touching writes", "[writecoalescer]") {
+  std::vector<Run> written;
+  replay::WriteCoalescer writes(
+      [&](const Run &run) { written.push_back(run); });
+
+  // sequential and overlapping writes form one run
+  writes.add(node(1), 0, 100, 10);
+  writes.add(node(1), 100, 100, 10);
+  writes.add(node(1), 50, 200, 10);
+  writes.add(node(1), 0, 0, 10);
+  REQUIRE(written.empty());
+  REQUIRE(writes.pending() == 1);
+  REQUIRE(writes.coalesced() == 2);
+
+  // a gap writes the run
+  writes.add(node(1), 400, 100, 11);
+  REQUIRE(written.size() == 1);
+  REQUIRE(written[0].node == node(1));
+  REQUIRE(written[0].start == 0);
+  REQUIRE(written[0].end == 250);
+
+  // every file has its own run
+  writes.add(node(2), 500, 100, 11);
+  writes.add(node(1), 500, 100, 11);
+  REQUIRE(writes.pending() == 2);
+
+  writes.flush(node(2));
+  REQUIRE(written.size() == 2);
+  REQUIRE(written[1].node == node(2));
+
+  writes.flushBefore(12);
+  REQUIRE(written.size() == 3);
+  REQUIRE(written[2].start == 400);
+  REQUIRE(written[2].end == 600);
+  REQUIRE(writes.pending() == 0);
+}
+
+TEST_CASE("WriteCoalescer limits the runs", "[writecoalescer]") {
+  std::vector<Run> written;
+  replay::WriteCoalescer writes(
+      [&](const Run &run) { written.push_back(run); });
+
+  // the oldest run is written, when there are too many
+  for (long i = 0; i <= WRITE_COALESCE_STREAMS; ++i)
+    writes.add(node(i), 0, 10, i);
+  REQUIRE(written.size() == 1);
+  REQUIRE(written[0].node == node(0));
+  REQUIRE(writes.pending() == WRITE_COALESCE_STREAMS);
+
+  writes.flushBefore(5);
+  REQUIRE(written.size() == 5);
+  REQUIRE(written[4].node == node(4));
+
+  writes.flushAll();
+  written.clear();
+
+  // a run never grows beyond the limit
+  const uint64_t chunk = 64 * 1024;
+  for (uint64_t offset = 0; offset < 3 * WRITE_COALESCE_BYTES; offset += chunk)
+    writes.add(node(1), offset, chunk, 0);
+  writes.flushAll();
+
+  REQUIRE(written.size() == 3);
+  for (auto &run : written)
+    REQUIRE(run.end - run.start == WRITE_COALESCE_BYTES);
+}
+
+TEST_CASE("WriteCoalescer writes every byte", "[writecoalescer]") {
+  const long files = 20;
+  // bytes that were added but not written yet and all added bytes
+  std::vector<std::set<uint64_t>> dirty(files);
+  std::vector<std::set<uint64_t>> added(files);
+  std::mt19937 rng(42);
+
+  replay::WriteCoalescer writes([&](const Run &run) {
+    long i = reinterpret_cast<long>(run.node) / 64;
+    for (uint64_t b = run.start; b < run.end; ++b) {
+      REQUIRE(added[i].count(b));
+      dirty[i].erase(b);
+    }
+  });
+
+  for (int step = 0; step < 20000; ++step) {
+    long i = rng() % files;
+    uint64_t offset = rng() % 2000;
+    uint64_t count = rng() % 100;
+
+    if (rng() % 50 == 0) {
+      writes.flush(node(i));
+      REQUIRE(dirty[i].empty());
+      continue;
+    }
+
+    writes.add(node(i), offset, count, step / 100);
+    for (uint64_t b = offset; b < offset + count; ++b) {
+      dirty[i].insert(b);
+      added[i].insert(b);
+    }
+  }
+
+  writes.flushAll();
+  for (auto &bytes : dirty) REQUIRE(bytes.empty());
+}
+
+}  // namespace test